@@ -0,0 +1,1062 @@
+#include "npfrida-host-browser.h"
+
+#include <json-glib/json-glib.h>
+#include <string.h>
+
+typedef struct _NPFridaHostIdentifier NPFridaHostIdentifier;
+typedef struct _NPFridaHostObject NPFridaHostObject;
+typedef struct _NPFridaHostFunction NPFridaHostFunction;
+typedef struct _NPFridaHostTask NPFridaHostTask;
+
+/*
+ * The plugin reads string identifiers by casting them to NPString, like the
+ * browsers it targets do internally, so the string has to come first.
+ */
+struct _NPFridaHostIdentifier
+{
+  NPString string;
+  gboolean is_string;
+  int32_t value;
+};
+
+struct _NPFridaHostObject
+{
+  NPObject np_object;
+  GHashTable * members;
+  GPtrArray * keys;
+  GArray * elements;
+};
+
+struct _NPFridaHostFunction
+{
+  NPObject np_object;
+  NPFridaHostFunc func;
+  gpointer user_data;
+};
+
+struct _NPFridaHostTask
+{
+  void (* func) (void * data);
+  void * data;
+};
+
+static void npfrida_host_builder_add (JsonBuilder * builder, const NPVariant * value, guint depth);
+static void npfrida_host_node_to_variant (JsonNode * node, NPVariant * result);
+static void npfrida_host_variant_free (gpointer data);
+
+static NPNetscapeFuncs npfrida_host_funcs;
+
+G_LOCK_DEFINE_STATIC (npfrida_host_identifiers);
+static GHashTable * npfrida_host_string_identifiers = NULL;
+static GHashTable * npfrida_host_int_identifiers = NULL;
+
+G_LOCK_DEFINE_STATIC (npfrida_host_exception);
+static gchar * npfrida_host_exception = NULL;
+
+static GAsyncQueue * npfrida_host_tasks = NULL;
+static NPObject * npfrida_host_window = NULL;
+
+/* Identifiers */
+
+static NPFridaHostIdentifier *
+npfrida_host_identifier_new (const gchar * str, gboolean is_string, int32_t value)
+{
+  NPFridaHostIdentifier * identifier;
+
+  identifier = g_slice_new (NPFridaHostIdentifier);
+  identifier->string.UTF8Characters = g_strdup (str);
+  identifier->string.UTF8Length = strlen (str);
+  identifier->is_string = is_string;
+  identifier->value = value;
+
+  return identifier;
+}
+
+static void
+npfrida_host_identifier_free (gpointer data)
+{
+  NPFridaHostIdentifier * identifier = static_cast<NPFridaHostIdentifier *> (data);
+
+  g_free (const_cast<NPUTF8 *> (identifier->string.UTF8Characters));
+  g_slice_free (NPFridaHostIdentifier, identifier);
+}
+
+static NPIdentifier
+npfrida_host_get_string_identifier (const NPUTF8 * name)
+{
+  NPFridaHostIdentifier * identifier;
+
+  G_LOCK (npfrida_host_identifiers);
+  identifier = static_cast<NPFridaHostIdentifier *> (g_hash_table_lookup (npfrida_host_string_identifiers, name));
+  if (identifier == NULL)
+  {
+    identifier = npfrida_host_identifier_new (name, TRUE, 0);
+    g_hash_table_insert (npfrida_host_string_identifiers, const_cast<NPUTF8 *> (identifier->string.UTF8Characters), identifier);
+  }
+  G_UNLOCK (npfrida_host_identifiers);
+
+  return identifier;
+}
+
+static void
+npfrida_host_get_string_identifiers (const NPUTF8 ** names, int32_t name_count, NPIdentifier * identifiers)
+{
+  int32_t i;
+
+  for (i = 0; i != name_count; i++)
+    identifiers[i] = npfrida_host_get_string_identifier (names[i]);
+}
+
+static NPIdentifier
+npfrida_host_get_int_identifier (int32_t intid)
+{
+  NPFridaHostIdentifier * identifier;
+
+  G_LOCK (npfrida_host_identifiers);
+  identifier = static_cast<NPFridaHostIdentifier *> (g_hash_table_lookup (npfrida_host_int_identifiers, GINT_TO_POINTER (intid)));
+  if (identifier == NULL)
+  {
+    gchar str[16];
+
+    g_snprintf (str, sizeof (str), "%d", intid);
+    identifier = npfrida_host_identifier_new (str, FALSE, intid);
+    g_hash_table_insert (npfrida_host_int_identifiers, GINT_TO_POINTER (intid), identifier);
+  }
+  G_UNLOCK (npfrida_host_identifiers);
+
+  return identifier;
+}
+
+static bool
+npfrida_host_identifier_is_string (NPIdentifier identifier)
+{
+  return static_cast<NPFridaHostIdentifier *> (identifier)->is_string != FALSE;
+}
+
+static NPUTF8 *
+npfrida_host_utf8_from_identifier (NPIdentifier identifier)
+{
+  NPFridaHostIdentifier * self = static_cast<NPFridaHostIdentifier *> (identifier);
+
+  if (!self->is_string)
+    return NULL;
+
+  return g_strdup (self->string.UTF8Characters);
+}
+
+static int32_t
+npfrida_host_int_from_identifier (NPIdentifier identifier)
+{
+  NPFridaHostIdentifier * self = static_cast<NPFridaHostIdentifier *> (identifier);
+
+  return self->is_string ? G_MININT32 : self->value;
+}
+
+/* Objects */
+
+static NPObject *
+npfrida_host_create_object (NPP npp, NPClass * klass)
+{
+  NPObject * obj;
+
+  if (klass->allocate != NULL)
+    obj = klass->allocate (npp, klass);
+  else
+    obj = g_new0 (NPObject, 1);
+  obj->_class = klass;
+  obj->referenceCount = 1;
+
+  return obj;
+}
+
+static NPObject *
+npfrida_host_retain_object (NPObject * obj)
+{
+  g_atomic_int_inc (reinterpret_cast<volatile gint *> (&obj->referenceCount));
+  return obj;
+}
+
+static void
+npfrida_host_release_object (NPObject * obj)
+{
+  if (g_atomic_int_dec_and_test (reinterpret_cast<volatile gint *> (&obj->referenceCount)))
+  {
+    if (obj->_class->deallocate != NULL)
+      obj->_class->deallocate (obj);
+    else
+      g_free (obj);
+  }
+}
+
+static bool
+npfrida_host_invoke (NPP npp, NPObject * obj, NPIdentifier name, const NPVariant * args, uint32_t arg_count, NPVariant * result)
+{
+  (void) npp;
+
+  VOID_TO_NPVARIANT (*result);
+  if (obj->_class->invoke == NULL)
+    return false;
+  return obj->_class->invoke (obj, name, args, arg_count, result);
+}
+
+static bool
+npfrida_host_invoke_default (NPP npp, NPObject * obj, const NPVariant * args, uint32_t arg_count, NPVariant * result)
+{
+  (void) npp;
+
+  VOID_TO_NPVARIANT (*result);
+  if (obj->_class->invokeDefault == NULL)
+    return false;
+  return obj->_class->invokeDefault (obj, args, arg_count, result);
+}
+
+static bool
+npfrida_host_get_property_by_id (NPP npp, NPObject * obj, NPIdentifier name, NPVariant * result)
+{
+  (void) npp;
+
+  VOID_TO_NPVARIANT (*result);
+  if (obj->_class->getProperty == NULL)
+    return false;
+  return obj->_class->getProperty (obj, name, result);
+}
+
+static bool
+npfrida_host_set_property_by_id (NPP npp, NPObject * obj, NPIdentifier name, const NPVariant * value)
+{
+  (void) npp;
+
+  if (obj->_class->setProperty == NULL)
+    return false;
+  return obj->_class->setProperty (obj, name, value);
+}
+
+static bool
+npfrida_host_remove_property (NPP npp, NPObject * obj, NPIdentifier name)
+{
+  (void) npp;
+
+  if (obj->_class->removeProperty == NULL)
+    return false;
+  return obj->_class->removeProperty (obj, name);
+}
+
+static bool
+npfrida_host_has_property (NPP npp, NPObject * obj, NPIdentifier name)
+{
+  (void) npp;
+
+  if (obj->_class->hasProperty == NULL)
+    return false;
+  return obj->_class->hasProperty (obj, name);
+}
+
+static bool
+npfrida_host_has_method (NPP npp, NPObject * obj, NPIdentifier name)
+{
+  (void) npp;
+
+  if (obj->_class->hasMethod == NULL)
+    return false;
+  return obj->_class->hasMethod (obj, name);
+}
+
+static bool
+npfrida_host_enumerate (NPP npp, NPObject * obj, NPIdentifier ** identifiers, uint32_t * count)
+{
+  (void) npp;
+
+  if (!NP_CLASS_STRUCT_VERSION_HAS_ENUM (obj->_class) || obj->_class->enumerate == NULL)
+    return false;
+  return obj->_class->enumerate (obj, identifiers, count);
+}
+
+static void
+npfrida_host_release_variant_value (NPVariant * variant)
+{
+  switch (variant->type)
+  {
+    case NPVariantType_String:
+      g_free (const_cast<NPUTF8 *> (variant->value.stringValue.UTF8Characters));
+      break;
+    case NPVariantType_Object:
+      npfrida_host_release_object (variant->value.objectValue);
+      break;
+    default:
+      break;
+  }
+
+  VOID_TO_NPVARIANT (*variant);
+}
+
+static void
+npfrida_host_set_exception (NPObject * obj, const NPUTF8 * message)
+{
+  (void) obj;
+
+  G_LOCK (npfrida_host_exception);
+  g_free (npfrida_host_exception);
+  npfrida_host_exception = g_strdup (message);
+  G_UNLOCK (npfrida_host_exception);
+}
+
+/* Browser services */
+
+static NPError
+npfrida_host_get_value (NPP instance, NPNVariable variable, void * value)
+{
+  (void) instance;
+
+  if (variable == NPNVWindowNPObject)
+  {
+    *(static_cast<NPObject **> (value)) = npfrida_host_retain_object (npfrida_host_window);
+    return NPERR_NO_ERROR;
+  }
+
+  return NPERR_INVALID_PARAM;
+}
+
+static NPError
+npfrida_host_set_value (NPP instance, NPPVariable variable, void * value)
+{
+  (void) instance;
+  (void) variable;
+  (void) value;
+
+  return NPERR_NO_ERROR;
+}
+
+static const char *
+npfrida_host_user_agent (NPP instance)
+{
+  (void) instance;
+
+  return "npfrida-host";
+}
+
+static void *
+npfrida_host_mem_alloc (uint32_t size)
+{
+  return g_malloc (size);
+}
+
+static void
+npfrida_host_mem_free (void * ptr)
+{
+  g_free (ptr);
+}
+
+static uint32_t
+npfrida_host_mem_flush (uint32_t size)
+{
+  (void) size;
+
+  return 0;
+}
+
+static void
+npfrida_host_plugin_thread_async_call (NPP instance, void (* func) (void *), void * data)
+{
+  NPFridaHostTask * task;
+
+  (void) instance;
+
+  task = g_slice_new (NPFridaHostTask);
+  task->func = func;
+  task->data = data;
+  g_async_queue_push (npfrida_host_tasks, task);
+}
+
+/* Plain objects and arrays */
+
+static NPObject *
+npfrida_host_object_allocate (NPP npp, NPClass * klass)
+{
+  NPFridaHostObject * obj;
+
+  (void) npp;
+  (void) klass;
+
+  obj = g_slice_new0 (NPFridaHostObject);
+  obj->members = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, npfrida_host_variant_free);
+  obj->keys = g_ptr_array_new_with_free_func (g_free);
+
+  return &obj->np_object;
+}
+
+static void
+npfrida_host_object_deallocate (NPObject * npobj)
+{
+  NPFridaHostObject * self = reinterpret_cast<NPFridaHostObject *> (npobj);
+  guint i;
+
+  g_hash_table_unref (self->members);
+  g_ptr_array_unref (self->keys);
+  if (self->elements != NULL)
+  {
+    for (i = 0; i != self->elements->len; i++)
+      npfrida_host_release_variant_value (&g_array_index (self->elements, NPVariant, i));
+    g_array_free (self->elements, TRUE);
+  }
+
+  g_slice_free (NPFridaHostObject, self);
+}
+
+static NPVariant *
+npfrida_host_object_lookup (NPFridaHostObject * self, NPIdentifier name)
+{
+  NPFridaHostIdentifier * identifier = static_cast<NPFridaHostIdentifier *> (name);
+
+  if (identifier->is_string)
+    return static_cast<NPVariant *> (g_hash_table_lookup (self->members, identifier->string.UTF8Characters));
+
+  if (self->elements != NULL && identifier->value >= 0 && static_cast<guint> (identifier->value) < self->elements->len)
+    return &g_array_index (self->elements, NPVariant, identifier->value);
+
+  return NULL;
+}
+
+static gboolean
+npfrida_host_object_is_length (NPFridaHostObject * self, NPIdentifier name)
+{
+  NPFridaHostIdentifier * identifier = static_cast<NPFridaHostIdentifier *> (name);
+
+  return self->elements != NULL && identifier->is_string && strcmp (identifier->string.UTF8Characters, "length") == 0;
+}
+
+static bool
+npfrida_host_object_has_method (NPObject * npobj, NPIdentifier name)
+{
+  NPVariant * member;
+
+  member = npfrida_host_object_lookup (reinterpret_cast<NPFridaHostObject *> (npobj), name);
+
+  return member != NULL && NPVARIANT_IS_OBJECT (*member) && NPVARIANT_TO_OBJECT (*member)->_class->invokeDefault != NULL;
+}
+
+static bool
+npfrida_host_object_invoke (NPObject * npobj, NPIdentifier name, const NPVariant * args, uint32_t arg_count, NPVariant * result)
+{
+  NPVariant * member;
+
+  member = npfrida_host_object_lookup (reinterpret_cast<NPFridaHostObject *> (npobj), name);
+  if (member == NULL || !NPVARIANT_IS_OBJECT (*member))
+  {
+    npfrida_host_set_exception (npobj, "not a function");
+    return false;
+  }
+
+  return npfrida_host_invoke_default (NULL, NPVARIANT_TO_OBJECT (*member), args, arg_count, result);
+}
+
+static bool
+npfrida_host_object_has_property (NPObject * npobj, NPIdentifier name)
+{
+  NPFridaHostObject * self = reinterpret_cast<NPFridaHostObject *> (npobj);
+
+  return npfrida_host_object_lookup (self, name) != NULL || npfrida_host_object_is_length (self, name);
+}
+
+static bool
+npfrida_host_object_get_property (NPObject * npobj, NPIdentifier name, NPVariant * result)
+{
+  NPFridaHostObject * self = reinterpret_cast<NPFridaHostObject *> (npobj);
+  NPVariant * member;
+
+  member = npfrida_host_object_lookup (self, name);
+  if (member != NULL)
+    npfrida_host_variant_copy (result, member);
+  else if (npfrida_host_object_is_length (self, name))
+    INT32_TO_NPVARIANT (self->elements->len, *result);
+  else
+    VOID_TO_NPVARIANT (*result);
+
+  return true;
+}
+
+static bool
+npfrida_host_object_set_property (NPObject * npobj, NPIdentifier name, const NPVariant * value)
+{
+  NPFridaHostObject * self = reinterpret_cast<NPFridaHostObject *> (npobj);
+  NPFridaHostIdentifier * identifier = static_cast<NPFridaHostIdentifier *> (name);
+  NPVariant * copy;
+
+  if (identifier->is_string)
+  {
+    gchar * key;
+
+    copy = g_slice_new (NPVariant);
+    npfrida_host_variant_copy (copy, value);
+
+    if (!g_hash_table_contains (self->members, identifier->string.UTF8Characters))
+    {
+      key = g_strdup (identifier->string.UTF8Characters);
+      g_ptr_array_add (self->keys, key);
+    }
+    g_hash_table_insert (self->members, const_cast<NPUTF8 *> (identifier->string.UTF8Characters), copy);
+
+    return true;
+  }
+
+  if (self->elements == NULL || identifier->value < 0)
+    return false;
+
+  if (static_cast<guint> (identifier->value) >= self->elements->len)
+  {
+    guint old_length = self->elements->len, i;
+
+    g_array_set_size (self->elements, identifier->value + 1);
+    for (i = old_length; i != self->elements->len; i++)
+      VOID_TO_NPVARIANT (g_array_index (self->elements, NPVariant, i));
+  }
+
+  copy = &g_array_index (self->elements, NPVariant, identifier->value);
+  npfrida_host_release_variant_value (copy);
+  npfrida_host_variant_copy (copy, value);
+
+  return true;
+}
+
+static bool
+npfrida_host_object_enumerate (NPObject * npobj, NPIdentifier ** value, uint32_t * count)
+{
+  NPFridaHostObject * self = reinterpret_cast<NPFridaHostObject *> (npobj);
+  NPIdentifier * identifiers;
+  guint n, i;
+
+  n = (self->elements != NULL) ? self->elements->len : self->keys->len;
+  identifiers = static_cast<NPIdentifier *> (g_malloc (MAX (n, 1) * sizeof (NPIdentifier)));
+  for (i = 0; i != n; i++)
+  {
+    if (self->elements != NULL)
+      identifiers[i] = npfrida_host_get_int_identifier (i);
+    else
+      identifiers[i] = npfrida_host_get_string_identifier (static_cast<const gchar *> (g_ptr_array_index (self->keys, i)));
+  }
+
+  *value = identifiers;
+  *count = n;
+  return true;
+}
+
+static NPClass npfrida_host_object_class =
+{
+  NP_CLASS_STRUCT_VERSION,
+  npfrida_host_object_allocate,
+  npfrida_host_object_deallocate,
+  NULL,
+  npfrida_host_object_has_method,
+  npfrida_host_object_invoke,
+  NULL,
+  npfrida_host_object_has_property,
+  npfrida_host_object_get_property,
+  npfrida_host_object_set_property,
+  NULL,
+  npfrida_host_object_enumerate,
+  NULL
+};
+
+NPObject *
+npfrida_host_object_new (void)
+{
+  return npfrida_host_create_object (NULL, &npfrida_host_object_class);
+}
+
+NPObject *
+npfrida_host_array_new (void)
+{
+  NPFridaHostObject * obj;
+
+  obj = reinterpret_cast<NPFridaHostObject *> (npfrida_host_object_new ());
+  obj->elements = g_array_new (FALSE, FALSE, sizeof (NPVariant));
+
+  return &obj->np_object;
+}
+
+/* Functions */
+
+static NPObject *
+npfrida_host_function_allocate (NPP npp, NPClass * klass)
+{
+  (void) npp;
+  (void) klass;
+
+  return &g_slice_new0 (NPFridaHostFunction)->np_object;
+}
+
+static void
+npfrida_host_function_deallocate (NPObject * npobj)
+{
+  g_slice_free (NPFridaHostFunction, reinterpret_cast<NPFridaHostFunction *> (npobj));
+}
+
+static bool
+npfrida_host_function_invoke_default (NPObject * npobj, const NPVariant * args, uint32_t arg_count, NPVariant * result)
+{
+  NPFridaHostFunction * self = reinterpret_cast<NPFridaHostFunction *> (npobj);
+
+  VOID_TO_NPVARIANT (*result);
+  self->func (args, arg_count, result, self->user_data);
+
+  return true;
+}
+
+static NPClass npfrida_host_function_class =
+{
+  NP_CLASS_STRUCT_VERSION,
+  npfrida_host_function_allocate,
+  npfrida_host_function_deallocate,
+  NULL,
+  NULL,
+  NULL,
+  npfrida_host_function_invoke_default,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  NULL
+};
+
+NPObject *
+npfrida_host_function_new (NPFridaHostFunc func, gpointer user_data)
+{
+  NPFridaHostFunction * obj;
+
+  obj = reinterpret_cast<NPFridaHostFunction *> (npfrida_host_create_object (NULL, &npfrida_host_function_class));
+  obj->func = func;
+  obj->user_data = user_data;
+
+  return &obj->np_object;
+}
+
+/* Globals exposed on the window */
+
+static void
+npfrida_host_json_parse (const NPVariant * args, uint32_t arg_count, NPVariant * result, gpointer user_data)
+{
+  JsonParser * parser;
+
+  (void) user_data;
+
+  if (arg_count != 1 || !NPVARIANT_IS_STRING (args[0]))
+  {
+    npfrida_host_set_exception (NULL, "JSON.parse expects a string");
+    return;
+  }
+
+  parser = json_parser_new ();
+  if (json_parser_load_from_data (parser, args[0].value.stringValue.UTF8Characters, args[0].value.stringValue.UTF8Length, NULL))
+    npfrida_host_node_to_variant (json_parser_get_root (parser), result);
+  else
+    npfrida_host_set_exception (NULL, "JSON.parse: invalid JSON");
+  g_object_unref (parser);
+}
+
+static void
+npfrida_host_json_stringify (const NPVariant * args, uint32_t arg_count, NPVariant * result, gpointer user_data)
+{
+  gchar * json;
+
+  (void) user_data;
+
+  if (arg_count != 1)
+    return;
+
+  json = npfrida_host_stringify (&args[0]);
+  STRINGZ_TO_NPVARIANT (json, *result);
+}
+
+static void
+npfrida_host_console_log (const NPVariant * args, uint32_t arg_count, NPVariant * result, gpointer user_data)
+{
+  uint32_t i;
+
+  (void) result;
+  (void) user_data;
+
+  for (i = 0; i != arg_count; i++)
+  {
+    gchar * str = npfrida_host_variant_to_cstring (&args[i]);
+    g_printerr ((i == 0) ? "%s" : " %s", str);
+    g_free (str);
+  }
+  g_printerr ("\n");
+}
+
+static void
+npfrida_host_object_constructor (const NPVariant * args, uint32_t arg_count, NPVariant * result, gpointer user_data)
+{
+  (void) args;
+  (void) arg_count;
+  (void) user_data;
+
+  OBJECT_TO_NPVARIANT (npfrida_host_object_new (), *result);
+}
+
+static void
+npfrida_host_set_function (NPObject * obj, const gchar * name, NPFridaHostFunc func)
+{
+  NPVariant value;
+
+  OBJECT_TO_NPVARIANT (npfrida_host_function_new (func, NULL), value);
+  npfrida_host_object_set_property (obj, npfrida_host_get_string_identifier (name), &value);
+  npfrida_host_release_variant_value (&value);
+}
+
+static void
+npfrida_host_set_object (NPObject * obj, const gchar * name, NPObject * member)
+{
+  NPVariant value;
+
+  OBJECT_TO_NPVARIANT (member, value);
+  npfrida_host_object_set_property (obj, npfrida_host_get_string_identifier (name), &value);
+  npfrida_host_release_variant_value (&value);
+}
+
+void
+npfrida_host_browser_init (void)
+{
+  NPNetscapeFuncs * f = &npfrida_host_funcs;
+  NPObject * json, * console;
+
+  npfrida_host_string_identifiers = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, npfrida_host_identifier_free);
+  npfrida_host_int_identifiers = g_hash_table_new_full (NULL, NULL, NULL, npfrida_host_identifier_free);
+  npfrida_host_tasks = g_async_queue_new ();
+
+  memset (f, 0, sizeof (NPNetscapeFuncs));
+  f->size = sizeof (NPNetscapeFuncs);
+  f->version = (NP_VERSION_MAJOR << 8) | NP_VERSION_MINOR;
+  f->uagent = npfrida_host_user_agent;
+  f->memalloc = npfrida_host_mem_alloc;
+  f->memfree = npfrida_host_mem_free;
+  f->memflush = npfrida_host_mem_flush;
+  f->getvalue = npfrida_host_get_value;
+  f->setvalue = npfrida_host_set_value;
+  f->getstringidentifier = npfrida_host_get_string_identifier;
+  f->getstringidentifiers = npfrida_host_get_string_identifiers;
+  f->getintidentifier = npfrida_host_get_int_identifier;
+  f->identifierisstring = npfrida_host_identifier_is_string;
+  f->utf8fromidentifier = npfrida_host_utf8_from_identifier;
+  f->intfromidentifier = npfrida_host_int_from_identifier;
+  f->createobject = npfrida_host_create_object;
+  f->retainobject = npfrida_host_retain_object;
+  f->releaseobject = npfrida_host_release_object;
+  f->invoke = npfrida_host_invoke;
+  f->invokeDefault = npfrida_host_invoke_default;
+  f->getproperty = npfrida_host_get_property_by_id;
+  f->setproperty = npfrida_host_set_property_by_id;
+  f->removeproperty = npfrida_host_remove_property;
+  f->hasproperty = npfrida_host_has_property;
+  f->hasmethod = npfrida_host_has_method;
+  f->releasevariantvalue = npfrida_host_release_variant_value;
+  f->setexception = npfrida_host_set_exception;
+  f->enumerate = npfrida_host_enumerate;
+  f->pluginthreadasynccall = npfrida_host_plugin_thread_async_call;
+
+  npfrida_host_window = npfrida_host_object_new ();
+
+  json = npfrida_host_object_new ();
+  npfrida_host_set_function (json, "parse", npfrida_host_json_parse);
+  npfrida_host_set_function (json, "stringify", npfrida_host_json_stringify);
+  npfrida_host_set_object (npfrida_host_window, "JSON", json);
+  npfrida_host_release_object (json);
+
+  console = npfrida_host_object_new ();
+  npfrida_host_set_function (console, "log", npfrida_host_console_log);
+  npfrida_host_set_object (npfrida_host_window, "console", console);
+  npfrida_host_release_object (console);
+
+  npfrida_host_set_function (npfrida_host_window, "Object", npfrida_host_object_constructor);
+}
+
+void
+npfrida_host_browser_deinit (void)
+{
+  NPFridaHostTask * task;
+
+  while ((task = static_cast<NPFridaHostTask *> (g_async_queue_try_pop (npfrida_host_tasks))) != NULL)
+    g_slice_free (NPFridaHostTask, task);
+  g_async_queue_unref (npfrida_host_tasks);
+  npfrida_host_tasks = NULL;
+
+  npfrida_host_release_object (npfrida_host_window);
+  npfrida_host_window = NULL;
+
+  g_hash_table_unref (npfrida_host_int_identifiers);
+  npfrida_host_int_identifiers = NULL;
+  g_hash_table_unref (npfrida_host_string_identifiers);
+  npfrida_host_string_identifiers = NULL;
+
+  g_free (npfrida_host_exception);
+  npfrida_host_exception = NULL;
+}
+
+NPNetscapeFuncs *
+npfrida_host_browser_get_funcs (void)
+{
+  return &npfrida_host_funcs;
+}
+
+/*
+ * Runs the tasks posted with pluginthreadasynccall, waiting up to timeout_usec
+ * for the first one. Returns FALSE if nothing ran.
+ */
+gboolean
+npfrida_host_browser_iterate (gint64 timeout_usec)
+{
+  NPFridaHostTask * task;
+
+  task = static_cast<NPFridaHostTask *> (g_async_queue_timeout_pop (npfrida_host_tasks, timeout_usec));
+  if (task == NULL)
+    return FALSE;
+
+  do
+  {
+    task->func (task->data);
+    g_slice_free (NPFridaHostTask, task);
+  }
+  while ((task = static_cast<NPFridaHostTask *> (g_async_queue_try_pop (npfrida_host_tasks))) != NULL);
+
+  return TRUE;
+}
+
+gchar *
+npfrida_host_browser_take_exception (void)
+{
+  gchar * message;
+
+  G_LOCK (npfrida_host_exception);
+  message = npfrida_host_exception;
+  npfrida_host_exception = NULL;
+  G_UNLOCK (npfrida_host_exception);
+
+  return message;
+}
+
+/* Helpers */
+
+gboolean
+npfrida_host_get_property (NPObject * obj, const gchar * name, NPVariant * result)
+{
+  return npfrida_host_get_property_by_id (NULL, obj, npfrida_host_get_string_identifier (name), result);
+}
+
+gboolean
+npfrida_host_get_element (NPObject * obj, gint index, NPVariant * result)
+{
+  return npfrida_host_get_property_by_id (NULL, obj, npfrida_host_get_int_identifier (index), result);
+}
+
+void
+npfrida_host_variant_copy (NPVariant * dst, const NPVariant * src)
+{
+  *dst = *src;
+
+  if (src->type == NPVariantType_String)
+  {
+    NPUTF8 * chars = static_cast<NPUTF8 *> (g_malloc (MAX (src->value.stringValue.UTF8Length, 1)));
+    memcpy (chars, src->value.stringValue.UTF8Characters, src->value.stringValue.UTF8Length);
+    dst->value.stringValue.UTF8Characters = chars;
+  }
+  else if (src->type == NPVariantType_Object)
+  {
+    npfrida_host_retain_object (src->value.objectValue);
+  }
+}
+
+gchar *
+npfrida_host_variant_to_cstring (const NPVariant * value)
+{
+  if (NPVARIANT_IS_STRING (*value))
+    return g_strndup (value->value.stringValue.UTF8Characters, value->value.stringValue.UTF8Length);
+
+  return npfrida_host_stringify (value);
+}
+
+gchar *
+npfrida_host_stringify (const NPVariant * value)
+{
+  JsonBuilder * builder;
+  JsonGenerator * generator;
+  JsonNode * root;
+  gchar * json;
+
+  builder = json_builder_new ();
+  npfrida_host_builder_add (builder, value, 0);
+  root = json_builder_get_root (builder);
+
+  generator = json_generator_new ();
+  json_generator_set_root (generator, root);
+  json = json_generator_to_data (generator, NULL);
+
+  g_object_unref (generator);
+  json_node_free (root);
+  g_object_unref (builder);
+
+  return json;
+}
+
+static void
+npfrida_host_builder_add (JsonBuilder * builder, const NPVariant * value, guint depth)
+{
+  NPObject * obj;
+  NPIdentifier * identifiers;
+  uint32_t count, i;
+  gboolean is_array;
+
+  switch (value->type)
+  {
+    case NPVariantType_Void:
+    case NPVariantType_Null:
+      json_builder_add_null_value (builder);
+      return;
+    case NPVariantType_Bool:
+      json_builder_add_boolean_value (builder, NPVARIANT_TO_BOOLEAN (*value));
+      return;
+    case NPVariantType_Int32:
+      json_builder_add_int_value (builder, NPVARIANT_TO_INT32 (*value));
+      return;
+    case NPVariantType_Double:
+      json_builder_add_double_value (builder, NPVARIANT_TO_DOUBLE (*value));
+      return;
+    case NPVariantType_String:
+    {
+      gchar * str = g_strndup (value->value.stringValue.UTF8Characters, value->value.stringValue.UTF8Length);
+      json_builder_add_string_value (builder, str);
+      g_free (str);
+      return;
+    }
+    case NPVariantType_Object:
+      break;
+  }
+
+  obj = NPVARIANT_TO_OBJECT (*value);
+  if (depth == 32 || !npfrida_host_enumerate (NULL, obj, &identifiers, &count))
+  {
+    json_builder_add_null_value (builder);
+    return;
+  }
+
+  /* Plugin-side lists enumerate integer identifiers only, treat them as arrays */
+  is_array = count != 0 ? !npfrida_host_identifier_is_string (identifiers[0]) :
+      npfrida_host_has_property (NULL, obj, npfrida_host_get_string_identifier ("length"));
+
+  if (is_array)
+    json_builder_begin_array (builder);
+  else
+    json_builder_begin_object (builder);
+
+  for (i = 0; i != count; i++)
+  {
+    NPVariant member;
+
+    npfrida_host_get_property_by_id (NULL, obj, identifiers[i], &member);
+    if (NPVARIANT_IS_OBJECT (member) && NPVARIANT_TO_OBJECT (member)->_class == &npfrida_host_function_class)
+    {
+      npfrida_host_release_variant_value (&member);
+      continue;
+    }
+
+    if (!is_array)
+      json_builder_set_member_name (builder, static_cast<NPFridaHostIdentifier *> (identifiers[i])->string.UTF8Characters);
+    npfrida_host_builder_add (builder, &member, depth + 1);
+    npfrida_host_release_variant_value (&member);
+  }
+
+  if (is_array)
+    json_builder_end_array (builder);
+  else
+    json_builder_end_object (builder);
+
+  g_free (identifiers);
+}
+
+static void
+npfrida_host_node_to_variant (JsonNode * node, NPVariant * result)
+{
+  switch (JSON_NODE_TYPE (node))
+  {
+    case JSON_NODE_OBJECT:
+    {
+      NPObject * obj = npfrida_host_object_new ();
+      GList * members, * cur;
+
+      members = json_object_get_members (json_node_get_object (node));
+      for (cur = members; cur != NULL; cur = cur->next)
+      {
+        const gchar * name = static_cast<const gchar *> (cur->data);
+        NPVariant member;
+
+        npfrida_host_node_to_variant (json_object_get_member (json_node_get_object (node), name), &member);
+        npfrida_host_object_set_property (obj, npfrida_host_get_string_identifier (name), &member);
+        npfrida_host_release_variant_value (&member);
+      }
+      g_list_free (members);
+
+      OBJECT_TO_NPVARIANT (obj, *result);
+      break;
+    }
+    case JSON_NODE_ARRAY:
+    {
+      NPObject * obj = npfrida_host_array_new ();
+      JsonArray * array = json_node_get_array (node);
+      guint length, i;
+
+      length = json_array_get_length (array);
+      for (i = 0; i != length; i++)
+      {
+        NPVariant element;
+
+        npfrida_host_node_to_variant (json_array_get_element (array, i), &element);
+        npfrida_host_object_set_property (obj, npfrida_host_get_int_identifier (i), &element);
+        npfrida_host_release_variant_value (&element);
+      }
+
+      OBJECT_TO_NPVARIANT (obj, *result);
+      break;
+    }
+    case JSON_NODE_VALUE:
+      switch (json_node_get_value_type (node))
+      {
+        case G_TYPE_INT64:
+        {
+          gint64 v = json_node_get_int (node);
+          if (v >= G_MININT32 && v <= G_MAXINT32)
+            INT32_TO_NPVARIANT (static_cast<int32_t> (v), *result);
+          else
+            DOUBLE_TO_NPVARIANT (static_cast<double> (v), *result);
+          break;
+        }
+        case G_TYPE_DOUBLE:
+          DOUBLE_TO_NPVARIANT (json_node_get_double (node), *result);
+          break;
+        case G_TYPE_BOOLEAN:
+          BOOLEAN_TO_NPVARIANT (json_node_get_boolean (node), *result);
+          break;
+        case G_TYPE_STRING:
+        {
+          NPVariant str;
+          STRINGZ_TO_NPVARIANT (json_node_get_string (node), str);
+          npfrida_host_variant_copy (result, &str);
+          break;
+        }
+        default:
+          NULL_TO_NPVARIANT (*result);
+          break;
+      }
+      break;
+    case JSON_NODE_NULL:
+      NULL_TO_NPVARIANT (*result);
+      break;
+  }
+}
+
+static void
+npfrida_host_variant_free (gpointer data)
+{
+  NPVariant * variant = static_cast<NPVariant *> (data);
+
+  npfrida_host_release_variant_value (variant);
+  g_slice_free (NPVariant, variant);
+}
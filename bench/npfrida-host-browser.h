@@ -0,0 +1,32 @@
+#ifndef __NPFRIDA_HOST_BROWSER_H__
+#define __NPFRIDA_HOST_BROWSER_H__
+
+#include <glib.h>
+#include "npfunctions.h"
+
+G_BEGIN_DECLS
+
+typedef void (* NPFridaHostFunc) (const NPVariant * args, uint32_t arg_count, NPVariant * result, gpointer user_data);
+
+void npfrida_host_browser_init (void);
+void npfrida_host_browser_deinit (void);
+
+NPNetscapeFuncs * npfrida_host_browser_get_funcs (void);
+
+gboolean npfrida_host_browser_iterate (gint64 timeout_usec);
+gchar * npfrida_host_browser_take_exception (void);
+
+NPObject * npfrida_host_object_new (void);
+NPObject * npfrida_host_array_new (void);
+NPObject * npfrida_host_function_new (NPFridaHostFunc func, gpointer user_data);
+
+gboolean npfrida_host_get_property (NPObject * obj, const gchar * name, NPVariant * result);
+gboolean npfrida_host_get_element (NPObject * obj, gint index, NPVariant * result);
+gchar * npfrida_host_stringify (const NPVariant * value);
+
+void npfrida_host_variant_copy (NPVariant * dst, const NPVariant * src);
+gchar * npfrida_host_variant_to_cstring (const NPVariant * value);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,780 @@
+#include "npfrida-host-browser.h"
+#include "npfrida-replay.h"
+
+#include <gmodule.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NPFRIDA_HOST_MIME_TYPE "application/x-vnd-frida"
+#define NPFRIDA_HOST_CALL_TIMEOUT (10 * G_USEC_PER_SEC)
+#define NPFRIDA_HOST_ERROR (g_quark_from_static_string ("npfrida-host-error"))
+
+/* Sends count messages, paced to rate per second unless rate is 0, each stamped with its send time */
+#define NPFRIDA_HOST_MESSAGE_SCRIPT \
+    "var count = %u, rate = %u, size = %u;\n" \
+    "var data = (size > 0) ? Memory.readByteArray(Memory.alloc(size), size) : null;\n" \
+    "var sent = 0, start = Date.now();\n" \
+    "function pump() {\n" \
+    "  var due = (rate === 0) ? count : Math.min(count, Math.ceil(rate * (Date.now() - start + 1) / 1000));\n" \
+    "  for (; sent < due; sent++) {\n" \
+    "    var message = { seq: sent, t: Date.now() };\n" \
+    "    if (data !== null)\n" \
+    "      send(message, data);\n" \
+    "    else\n" \
+    "      send(message);\n" \
+    "  }\n" \
+    "  if (sent < count)\n" \
+    "    setTimeout(pump, (rate === 0) ? 0 : 1);\n" \
+    "}\n" \
+    "setTimeout(pump, 0);\n"
+
+typedef NPError (* NPFridaHostInitializeFunc) (NPNetscapeFuncs * nf, NPPluginFuncs * pf);
+typedef NPError (* NPFridaHostShutdownFunc) (void);
+
+typedef struct _NPFridaHostRun NPFridaHostRun;
+typedef struct _NPFridaHostMessages NPFridaHostMessages;
+typedef struct _NPFridaHost NPFridaHost;
+typedef struct _NPFridaHostCall NPFridaHostCall;
+
+struct _NPFridaHost
+{
+  GModule * module;
+  NPFridaHostShutdownFunc shutdown;
+  NPPluginFuncs plugin_funcs;
+  NPP_t instance;
+  NPObject * root;
+  gboolean listening;
+  NPFridaHostMessages * messages;
+
+  /* Cost of loading the plugin versus first asking it for its scriptable object */
+  gint64 load_time;
+  gint64 activate_time;
+  glong base_rss;
+  glong loaded_rss;
+  glong active_rss;
+};
+
+struct _NPFridaHostRun
+{
+  const gchar * method;
+  GArray * args;
+
+  guint issued;
+  guint completed;
+  guint failed;
+  GArray * latencies;
+  GPtrArray * spent_promises;
+  NPVariant last_value;
+};
+
+struct _NPFridaHostMessages
+{
+  NPFridaHostRun * run;
+  guint expected;
+  guint data_length;
+  gint64 first_time;
+  gint64 last_time;
+};
+
+struct _NPFridaHostCall
+{
+  NPFridaHostRun * run;
+  NPObject * promise;
+  gint64 start_time;
+};
+
+static gboolean npfrida_host_open (NPFridaHost * host, const gchar * plugin_path, gchar ** params, GError ** error);
+static void npfrida_host_close (NPFridaHost * host);
+static void npfrida_host_report_startup (NPFridaHost * host);
+static glong npfrida_host_get_rss (void);
+
+static gboolean npfrida_host_find_local_device (NPFridaHost * host, guint * device_id);
+static gboolean npfrida_host_run_messages (NPFridaHost * host, guint device_id, guint pid, guint count, guint rate, guint size);
+static void npfrida_host_on_message (const NPVariant * args, uint32_t arg_count, NPVariant * result, gpointer user_data);
+
+static gboolean npfrida_host_call (NPFridaHost * host, NPFridaHostRun * run);
+static gboolean npfrida_host_run_latency (NPFridaHost * host, NPFridaHostRun * run, guint iterations);
+static gboolean npfrida_host_run_throughput (NPFridaHost * host, NPFridaHostRun * run, guint iterations, guint window);
+static gboolean npfrida_host_issue (NPFridaHost * host, NPFridaHostRun * run);
+static void npfrida_host_on_complete (const NPVariant * args, uint32_t arg_count, NPVariant * result, gpointer user_data);
+static void npfrida_host_on_done (const NPVariant * args, uint32_t arg_count, NPVariant * result, gpointer user_data);
+
+static void npfrida_host_run_init (NPFridaHostRun * run, const gchar * method);
+static void npfrida_host_run_clear (NPFridaHostRun * run);
+static void npfrida_host_run_add_uint (NPFridaHostRun * run, guint value);
+static void npfrida_host_run_add_string (NPFridaHostRun * run, const gchar * value);
+static void npfrida_host_run_report (NPFridaHostRun * run, const gchar * scenario, gint64 elapsed);
+
+static gchar * npfrida_host_plugin_path = NULL;
+static gint npfrida_host_iterations = 200;
+static gint npfrida_host_window = 16;
+static gchar * npfrida_host_scenario = NULL;
+static gchar ** npfrida_host_params = NULL;
+static gchar * npfrida_host_helper = NULL;
+static gint npfrida_host_message_count = 10000;
+static gint npfrida_host_message_rate = 0;
+static gint npfrida_host_message_size = 4096;
+static gchar * npfrida_host_replay = NULL;
+static gdouble npfrida_host_replay_speed = 1.0;
+
+static GOptionEntry npfrida_host_options[] =
+{
+  { "plugin", 'p', 0, G_OPTION_ARG_FILENAME, &npfrida_host_plugin_path, "Plugin to load", "PATH" },
+  { "iterations", 'n', 0, G_OPTION_ARG_INT, &npfrida_host_iterations, "Calls per scenario", "N" },
+  { "window", 'w', 0, G_OPTION_ARG_INT, &npfrida_host_window, "Calls in flight during throughput runs", "N" },
+  { "scenario", 's', 0, G_OPTION_ARG_STRING, &npfrida_host_scenario, "startup, latency, errors, processes, throughput, messages or all", "NAME" },
+  { "param", 'P', 0, G_OPTION_ARG_STRING_ARRAY, &npfrida_host_params, "Embed parameter passed to NPP_New", "KEY=VALUE" },
+  { "helper", 0, 0, G_OPTION_ARG_FILENAME, &npfrida_host_helper, "Process to spawn and attach to", "PATH" },
+  { "message-count", 0, 0, G_OPTION_ARG_INT, &npfrida_host_message_count, "Messages sent per message run", "N" },
+  { "message-rate", 0, 0, G_OPTION_ARG_INT, &npfrida_host_message_rate, "Messages per second, 0 for unpaced", "N" },
+  { "message-size", 0, 0, G_OPTION_ARG_INT, &npfrida_host_message_size, "Binary data attached to each message in the data run", "BYTES" },
+  { "replay", 'r', 0, G_OPTION_ARG_FILENAME, &npfrida_host_replay, "Replay a recording made with NPFRIDA_RECORD instead of running scenarios", "PATH" },
+  { "replay-speed", 0, 0, G_OPTION_ARG_DOUBLE, &npfrida_host_replay_speed, "Replay pacing relative to the recording, 0 for back to back", "FACTOR" },
+  { NULL }
+};
+
+int
+main (int argc, char * argv[])
+{
+  GOptionContext * context;
+  GError * error = NULL;
+  NPFridaHost host;
+  const gchar * scenario;
+  gboolean all, success = TRUE;
+
+  context = g_option_context_new ("- drive libnpfrida without a browser");
+  g_option_context_add_main_entries (context, npfrida_host_options, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+  {
+    g_printerr ("%s\n", error->message);
+    return 1;
+  }
+  g_option_context_free (context);
+
+  if (npfrida_host_plugin_path == NULL)
+    npfrida_host_plugin_path = g_strdup ("../src/.libs/libnpfrida.so");
+  scenario = (npfrida_host_scenario != NULL) ? npfrida_host_scenario : "all";
+  all = strcmp (scenario, "all") == 0;
+
+  npfrida_host_browser_init ();
+
+  if (!npfrida_host_open (&host, npfrida_host_plugin_path, npfrida_host_params, &error))
+  {
+    g_printerr ("Unable to load %s: %s\n", npfrida_host_plugin_path, error->message);
+    g_error_free (error);
+    npfrida_host_browser_deinit ();
+    return 1;
+  }
+
+  if (npfrida_host_replay != NULL)
+  {
+    success = npfrida_replay_run (&host.instance, host.root, npfrida_host_replay, npfrida_host_replay_speed, &error);
+    if (!success)
+    {
+      g_printerr ("Replay failed: %s\n", error->message);
+      g_clear_error (&error);
+    }
+
+    scenario = "";
+    all = FALSE;
+  }
+  else
+  {
+    if (all || strcmp (scenario, "startup") == 0)
+      npfrida_host_report_startup (&host);
+
+    g_print ("%-12s %-20s %8s %8s %10s %10s %10s %10s %10s %12s\n", "scenario", "method", "calls", "failed",
+        "min(us)", "mean(us)", "p50(us)", "p99(us)", "max(us)", "calls/s");
+  }
+
+  if (success && (all || strcmp (scenario, "latency") == 0))
+  {
+    NPFridaHostRun run;
+
+    npfrida_host_run_init (&run, "enumerateDevices");
+    success = npfrida_host_run_latency (&host, &run, npfrida_host_iterations);
+    npfrida_host_run_clear (&run);
+  }
+
+  if (success && (all || strcmp (scenario, "errors") == 0))
+  {
+    NPFridaHostRun run;
+
+    /* Rejected in the backend without touching any device, isolates the plugin's own overhead */
+    npfrida_host_run_init (&run, "detachFrom");
+    npfrida_host_run_add_uint (&run, G_MAXUINT32);
+    npfrida_host_run_add_uint (&run, 0);
+    success = npfrida_host_run_latency (&host, &run, npfrida_host_iterations);
+    npfrida_host_run_clear (&run);
+  }
+
+  if (success && (all || strcmp (scenario, "processes") == 0))
+  {
+    NPFridaHostRun run;
+    guint device_id;
+
+    success = npfrida_host_find_local_device (&host, &device_id);
+    if (success)
+    {
+      npfrida_host_run_init (&run, "enumerateProcesses");
+      npfrida_host_run_add_uint (&run, device_id);
+      success = npfrida_host_run_latency (&host, &run, MAX (npfrida_host_iterations / 10, 1));
+      npfrida_host_run_clear (&run);
+    }
+  }
+
+  if (success && (all || strcmp (scenario, "throughput") == 0))
+  {
+    NPFridaHostRun run;
+
+    npfrida_host_run_init (&run, "enumerateDevices");
+    success = npfrida_host_run_throughput (&host, &run, npfrida_host_iterations, MAX (npfrida_host_window, 1));
+    npfrida_host_run_clear (&run);
+  }
+
+  if (success && (all || strcmp (scenario, "messages") == 0))
+  {
+    const gchar * helper_argv[] = { (npfrida_host_helper != NULL) ? npfrida_host_helper : "sleep", "3600", NULL };
+    GPid helper;
+    guint device_id;
+
+    success = npfrida_host_find_local_device (&host, &device_id);
+    if (success && !g_spawn_async (NULL, const_cast<gchar **> (helper_argv), NULL, G_SPAWN_SEARCH_PATH, NULL, NULL, &helper, &error))
+    {
+      g_printerr ("Unable to spawn helper: %s\n", error->message);
+      g_clear_error (&error);
+      success = FALSE;
+    }
+
+    if (success)
+    {
+      success = npfrida_host_run_messages (&host, device_id, helper, npfrida_host_message_count, npfrida_host_message_rate, 0) &&
+          npfrida_host_run_messages (&host, device_id, helper, npfrida_host_message_count, npfrida_host_message_rate,
+              npfrida_host_message_size);
+
+      kill (helper, SIGKILL);
+      g_spawn_close_pid (helper);
+    }
+  }
+
+  npfrida_host_close (&host);
+  npfrida_host_browser_deinit ();
+
+  g_free (npfrida_host_plugin_path);
+  g_free (npfrida_host_scenario);
+  g_strfreev (npfrida_host_params);
+  g_free (npfrida_host_helper);
+  g_free (npfrida_host_replay);
+
+  return success ? 0 : 1;
+}
+
+static gboolean
+npfrida_host_open (NPFridaHost * host, const gchar * plugin_path, gchar ** params, GError ** error)
+{
+  NPFridaHostInitializeFunc initialize;
+  NPError err;
+  gchar ** argn, ** argv;
+  gint argc, i;
+  gint64 start;
+
+  memset (host, 0, sizeof (NPFridaHost));
+
+  host->base_rss = npfrida_host_get_rss ();
+  start = g_get_monotonic_time ();
+
+  host->module = g_module_open (plugin_path, G_MODULE_BIND_LOCAL);
+  if (host->module == NULL)
+    goto module_error;
+  if (!g_module_symbol (host->module, "NP_Initialize", reinterpret_cast<gpointer *> (&initialize)) ||
+      !g_module_symbol (host->module, "NP_Shutdown", reinterpret_cast<gpointer *> (&host->shutdown)))
+    goto module_error;
+
+  host->plugin_funcs.size = sizeof (NPPluginFuncs);
+  err = initialize (npfrida_host_browser_get_funcs (), &host->plugin_funcs);
+  if (err != NPERR_NO_ERROR)
+    goto plugin_error;
+
+  argc = (params != NULL) ? g_strv_length (params) : 0;
+  argn = g_new0 (gchar *, argc + 1);
+  argv = g_new0 (gchar *, argc + 1);
+  for (i = 0; i != argc; i++)
+  {
+    gchar ** tokens = g_strsplit (params[i], "=", 2);
+    argn[i] = g_strdup (tokens[0]);
+    argv[i] = g_strdup ((tokens[1] != NULL) ? tokens[1] : "");
+    g_strfreev (tokens);
+  }
+  err = host->plugin_funcs.newp (const_cast<char *> (NPFRIDA_HOST_MIME_TYPE), &host->instance, NP_EMBED, argc, argn, argv, NULL);
+  g_strfreev (argn);
+  g_strfreev (argv);
+  if (err != NPERR_NO_ERROR)
+    goto plugin_error;
+
+  host->load_time = g_get_monotonic_time () - start;
+  host->loaded_rss = npfrida_host_get_rss ();
+  start = g_get_monotonic_time ();
+
+  err = host->plugin_funcs.getvalue (&host->instance, NPPVpluginScriptableNPObject, &host->root);
+  if (err != NPERR_NO_ERROR)
+    goto plugin_error;
+
+  host->activate_time = g_get_monotonic_time () - start;
+  host->active_rss = npfrida_host_get_rss ();
+
+  return TRUE;
+
+module_error:
+  {
+    g_set_error (error, NPFRIDA_HOST_ERROR, 0, "%s", g_module_error ());
+    if (host->module != NULL)
+      g_module_close (host->module);
+    return FALSE;
+  }
+plugin_error:
+  {
+    g_set_error (error, NPFRIDA_HOST_ERROR, 0, "plugin returned error %d", err);
+    g_module_close (host->module);
+    return FALSE;
+  }
+}
+
+static void
+npfrida_host_close (NPFridaHost * host)
+{
+  if (host->root != NULL)
+    npfrida_host_browser_get_funcs ()->releaseobject (host->root);
+  host->plugin_funcs.destroy (&host->instance, NULL);
+
+  /* Deliver whatever the teardown still posted to the browser thread */
+  while (npfrida_host_browser_iterate (10000))
+    ;
+
+  host->shutdown ();
+  g_module_close (host->module);
+}
+
+static void
+npfrida_host_report_startup (NPFridaHost * host)
+{
+  g_print ("startup: load %.1f ms, rss %ld -> %ld KiB; first scriptable object %.1f ms, rss -> %ld KiB\n\n",
+      host->load_time / 1000.0, host->base_rss, host->loaded_rss,
+      host->activate_time / 1000.0, host->active_rss);
+}
+
+static glong
+npfrida_host_get_rss (void)
+{
+  gchar * contents;
+  glong pages = 0;
+
+  if (g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL))
+  {
+    sscanf (contents, "%*ld %ld", &pages);
+    g_free (contents);
+  }
+
+  return pages * (sysconf (_SC_PAGESIZE) / 1024);
+}
+
+static gboolean
+npfrida_host_find_local_device (NPFridaHost * host, guint * device_id)
+{
+  NPNetscapeFuncs * browser = npfrida_host_browser_get_funcs ();
+  NPFridaHostRun run;
+  NPObject * devices;
+  NPVariant device, value;
+  gboolean found = FALSE;
+  gint i;
+
+  npfrida_host_run_init (&run, "enumerateDevices");
+  if (npfrida_host_call (host, &run) && NPVARIANT_IS_OBJECT (run.last_value))
+  {
+    devices = NPVARIANT_TO_OBJECT (run.last_value);
+    for (i = 0; !found && npfrida_host_get_element (devices, i, &device) && NPVARIANT_IS_OBJECT (device); i++)
+    {
+      gchar * type = NULL;
+
+      if (npfrida_host_get_property (NPVARIANT_TO_OBJECT (device), "type", &value))
+        type = npfrida_host_variant_to_cstring (&value);
+      browser->releasevariantvalue (&value);
+
+      if (g_strcmp0 (type, "local") == 0)
+      {
+        npfrida_host_get_property (NPVARIANT_TO_OBJECT (device), "id", &value);
+        if (NPVARIANT_IS_INT32 (value) || NPVARIANT_IS_DOUBLE (value))
+        {
+          *device_id = NPVARIANT_IS_INT32 (value) ? NPVARIANT_TO_INT32 (value) : static_cast<guint> (NPVARIANT_TO_DOUBLE (value));
+          found = TRUE;
+        }
+        browser->releasevariantvalue (&value);
+      }
+
+      g_free (type);
+      browser->releasevariantvalue (&device);
+    }
+  }
+  npfrida_host_run_clear (&run);
+
+  if (!found)
+    g_printerr ("No local device available\n");
+
+  return found;
+}
+
+static gboolean
+npfrida_host_run_messages (NPFridaHost * host, guint device_id, guint pid, guint count, guint rate, guint size)
+{
+  NPNetscapeFuncs * browser = npfrida_host_browser_get_funcs ();
+  NPFridaHostRun received, attach, detach;
+  NPFridaHostMessages messages;
+  NPVariant args[3], result;
+  gchar * source;
+  gint64 deadline;
+  gboolean success;
+
+  npfrida_host_run_init (&received, (size == 0) ? "send" : "send+data");
+  messages.run = &received;
+  messages.expected = count;
+  messages.data_length = size;
+  messages.first_time = 0;
+  messages.last_time = 0;
+
+  /* There is no way to remove a listener, so one is shared by all runs */
+  if (!host->listening)
+  {
+    NPObject * listener, * filter;
+
+    filter = npfrida_host_object_new ();
+    DOUBLE_TO_NPVARIANT (static_cast<double> (pid), args[0]);
+    browser->setproperty (NULL, filter, browser->getstringidentifier ("pid"), &args[0]);
+
+    listener = npfrida_host_function_new (npfrida_host_on_message, host);
+    STRINGZ_TO_NPVARIANT ("message", args[0]);
+    OBJECT_TO_NPVARIANT (listener, args[1]);
+    OBJECT_TO_NPVARIANT (filter, args[2]);
+    browser->invoke (&host->instance, host->root, browser->getstringidentifier ("addEventListener"), args, 3, &result);
+    browser->releasevariantvalue (&result);
+    browser->releaseobject (filter);
+    browser->releaseobject (listener);
+    host->listening = TRUE;
+  }
+  host->messages = &messages;
+
+  source = g_strdup_printf (NPFRIDA_HOST_MESSAGE_SCRIPT, count, rate, size);
+  npfrida_host_run_init (&attach, "attachTo");
+  npfrida_host_run_add_uint (&attach, device_id);
+  npfrida_host_run_add_uint (&attach, pid);
+  npfrida_host_run_add_string (&attach, source);
+  success = npfrida_host_call (host, &attach) && attach.failed == 0;
+  npfrida_host_run_clear (&attach);
+  g_free (source);
+
+  deadline = g_get_monotonic_time () + NPFRIDA_HOST_CALL_TIMEOUT;
+  while (success && received.completed != count)
+  {
+    if (npfrida_host_browser_iterate (deadline - g_get_monotonic_time ()))
+      deadline = g_get_monotonic_time () + NPFRIDA_HOST_CALL_TIMEOUT;
+    else if (g_get_monotonic_time () >= deadline)
+    {
+      g_printerr ("Only %u of %u messages arrived\n", received.completed, count);
+      success = FALSE;
+    }
+  }
+
+  if (success)
+    npfrida_host_run_report (&received, "messages", messages.last_time - messages.first_time);
+
+  npfrida_host_run_init (&detach, "detachFrom");
+  npfrida_host_run_add_uint (&detach, device_id);
+  npfrida_host_run_add_uint (&detach, pid);
+  npfrida_host_call (host, &detach);
+  npfrida_host_run_clear (&detach);
+
+  /* Stragglers are dropped rather than counted towards the next run */
+  while (npfrida_host_browser_iterate (10000))
+    ;
+  host->messages = NULL;
+  npfrida_host_run_clear (&received);
+
+  return success;
+}
+
+/*
+ * Latency is the script's Date.now() stamp against the host's wall clock, so
+ * it has millisecond resolution; both sides run on the same machine.
+ */
+static void
+npfrida_host_on_message (const NPVariant * args, uint32_t arg_count, NPVariant * result, gpointer user_data)
+{
+  NPFridaHost * host = static_cast<NPFridaHost *> (user_data);
+  NPFridaHostMessages * messages = host->messages;
+  NPFridaHostRun * run;
+  NPNetscapeFuncs * browser = npfrida_host_browser_get_funcs ();
+  NPVariant payload, stamp;
+  gint64 now;
+  gdouble latency;
+
+  (void) result;
+
+  if (messages == NULL || arg_count < 3 || !NPVARIANT_IS_OBJECT (args[2]))
+    return;
+  run = messages->run;
+
+  now = g_get_monotonic_time ();
+  if (run->completed == 0)
+    messages->first_time = now;
+  messages->last_time = now;
+
+  if (npfrida_host_get_property (NPVARIANT_TO_OBJECT (args[2]), "payload", &payload) && NPVARIANT_IS_OBJECT (payload) &&
+      npfrida_host_get_property (NPVARIANT_TO_OBJECT (payload), "t", &stamp))
+  {
+    if (NPVARIANT_IS_DOUBLE (stamp) || NPVARIANT_IS_INT32 (stamp))
+    {
+      latency = g_get_real_time () - 1000.0 * (NPVARIANT_IS_DOUBLE (stamp) ? NPVARIANT_TO_DOUBLE (stamp) : NPVARIANT_TO_INT32 (stamp));
+      g_array_append_val (run->latencies, latency);
+    }
+    browser->releasevariantvalue (&stamp);
+  }
+  browser->releasevariantvalue (&payload);
+
+  if (messages->data_length != 0 && (arg_count < 4 || !NPVARIANT_IS_OBJECT (args[3])))
+    run->failed++;
+
+  run->completed++;
+}
+
+static gboolean
+npfrida_host_call (NPFridaHost * host, NPFridaHostRun * run)
+{
+  gint64 deadline;
+
+  if (!npfrida_host_issue (host, run))
+    return FALSE;
+
+  deadline = g_get_monotonic_time () + NPFRIDA_HOST_CALL_TIMEOUT;
+  while (run->completed != run->issued)
+  {
+    if (!npfrida_host_browser_iterate (deadline - g_get_monotonic_time ()) && g_get_monotonic_time () >= deadline)
+    {
+      g_printerr ("%s timed out\n", run->method);
+      return FALSE;
+    }
+  }
+
+  g_ptr_array_set_size (run->spent_promises, 0);
+
+  return TRUE;
+}
+
+static gboolean
+npfrida_host_run_latency (NPFridaHost * host, NPFridaHostRun * run, guint iterations)
+{
+  gint64 start_time;
+
+  start_time = g_get_monotonic_time ();
+
+  while (run->completed != iterations)
+  {
+    if (!npfrida_host_call (host, run))
+      return FALSE;
+  }
+
+  npfrida_host_run_report (run, "latency", g_get_monotonic_time () - start_time);
+
+  return TRUE;
+}
+
+static gboolean
+npfrida_host_run_throughput (NPFridaHost * host, NPFridaHostRun * run, guint iterations, guint window)
+{
+  gint64 start_time, deadline;
+
+  start_time = g_get_monotonic_time ();
+  deadline = start_time + NPFRIDA_HOST_CALL_TIMEOUT;
+
+  while (run->completed != iterations)
+  {
+    while (run->issued != iterations && run->issued - run->completed < window)
+    {
+      if (!npfrida_host_issue (host, run))
+        return FALSE;
+    }
+
+    if (npfrida_host_browser_iterate (deadline - g_get_monotonic_time ()))
+    {
+      g_ptr_array_set_size (run->spent_promises, 0);
+      deadline = g_get_monotonic_time () + NPFRIDA_HOST_CALL_TIMEOUT;
+    }
+    else if (g_get_monotonic_time () >= deadline)
+    {
+      g_printerr ("%s timed out\n", run->method);
+      return FALSE;
+    }
+  }
+
+  npfrida_host_run_report (run, "throughput", g_get_monotonic_time () - start_time);
+
+  return TRUE;
+}
+
+static gboolean
+npfrida_host_issue (NPFridaHost * host, NPFridaHostRun * run)
+{
+  NPNetscapeFuncs * browser = npfrida_host_browser_get_funcs ();
+  NPFridaHostCall * call;
+  NPVariant promise, callback, chained;
+  NPObject * on_complete, * on_done;
+  gchar * exception;
+
+  call = g_slice_new (NPFridaHostCall);
+  call->run = run;
+  call->start_time = g_get_monotonic_time ();
+
+  VOID_TO_NPVARIANT (promise);
+  browser->invoke (&host->instance, host->root, browser->getstringidentifier (run->method),
+      reinterpret_cast<NPVariant *> (run->args->data), run->args->len, &promise);
+  exception = npfrida_host_browser_take_exception ();
+  if (exception != NULL || !NPVARIANT_IS_OBJECT (promise))
+  {
+    g_printerr ("%s failed: %s\n", run->method, (exception != NULL) ? exception : "no promise returned");
+    g_free (exception);
+    browser->releasevariantvalue (&promise);
+    g_slice_free (NPFridaHostCall, call);
+    return FALSE;
+  }
+  call->promise = NPVARIANT_TO_OBJECT (promise);
+  run->issued++;
+
+  on_done = npfrida_host_function_new (npfrida_host_on_done, run);
+  OBJECT_TO_NPVARIANT (on_done, callback);
+  browser->invoke (&host->instance, call->promise, browser->getstringidentifier ("done"), &callback, 1, &chained);
+  browser->releasevariantvalue (&chained);
+  browser->releaseobject (on_done);
+
+  on_complete = npfrida_host_function_new (npfrida_host_on_complete, call);
+  OBJECT_TO_NPVARIANT (on_complete, callback);
+  browser->invoke (&host->instance, call->promise, browser->getstringidentifier ("always"), &callback, 1, &chained);
+  browser->releasevariantvalue (&chained);
+  browser->releaseobject (on_complete);
+
+  return TRUE;
+}
+
+static void
+npfrida_host_on_done (const NPVariant * args, uint32_t arg_count, NPVariant * result, gpointer user_data)
+{
+  NPFridaHostRun * run = static_cast<NPFridaHostRun *> (user_data);
+  NPNetscapeFuncs * browser = npfrida_host_browser_get_funcs ();
+
+  (void) result;
+
+  browser->releasevariantvalue (&run->last_value);
+  if (arg_count != 0)
+    npfrida_host_variant_copy (&run->last_value, &args[0]);
+}
+
+static void
+npfrida_host_on_complete (const NPVariant * args, uint32_t arg_count, NPVariant * result, gpointer user_data)
+{
+  NPFridaHostCall * call = static_cast<NPFridaHostCall *> (user_data);
+  NPFridaHostRun * run = call->run;
+  NPNetscapeFuncs * browser = npfrida_host_browser_get_funcs ();
+  NPVariant state;
+  gdouble latency;
+
+  (void) args;
+  (void) arg_count;
+  (void) result;
+
+  latency = static_cast<gdouble> (g_get_monotonic_time () - call->start_time);
+  g_array_append_val (run->latencies, latency);
+
+  VOID_TO_NPVARIANT (state);
+  browser->invoke (NULL, call->promise, browser->getstringidentifier ("state"), NULL, 0, &state);
+  if (NPVARIANT_IS_STRING (state) && strncmp (state.value.stringValue.UTF8Characters, "rejected", state.value.stringValue.UTF8Length) == 0)
+    run->failed++;
+  browser->releasevariantvalue (&state);
+
+  run->completed++;
+
+  /* The promise is still iterating its callbacks, so the release has to wait until it is done */
+  g_ptr_array_add (run->spent_promises, call->promise);
+  g_slice_free (NPFridaHostCall, call);
+}
+
+static void
+npfrida_host_run_init (NPFridaHostRun * run, const gchar * method)
+{
+  run->method = method;
+  run->args = g_array_new (FALSE, FALSE, sizeof (NPVariant));
+  run->issued = 0;
+  run->completed = 0;
+  run->failed = 0;
+  run->latencies = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  run->spent_promises = g_ptr_array_new_with_free_func (reinterpret_cast<GDestroyNotify> (npfrida_host_browser_get_funcs ()->releaseobject));
+  VOID_TO_NPVARIANT (run->last_value);
+}
+
+static void
+npfrida_host_run_clear (NPFridaHostRun * run)
+{
+  g_array_free (run->args, TRUE);
+  g_array_free (run->latencies, TRUE);
+  g_ptr_array_unref (run->spent_promises);
+  npfrida_host_browser_get_funcs ()->releasevariantvalue (&run->last_value);
+}
+
+static void
+npfrida_host_run_add_uint (NPFridaHostRun * run, guint value)
+{
+  NPVariant arg;
+
+  DOUBLE_TO_NPVARIANT (static_cast<double> (value), arg);
+  g_array_append_val (run->args, arg);
+}
+
+static void
+npfrida_host_run_add_string (NPFridaHostRun * run, const gchar * value)
+{
+  NPVariant arg;
+
+  STRINGZ_TO_NPVARIANT (value, arg);
+  g_array_append_val (run->args, arg);
+}
+
+static gint
+npfrida_host_compare_latency (gconstpointer a, gconstpointer b)
+{
+  gdouble lhs = *static_cast<const gdouble *> (a), rhs = *static_cast<const gdouble *> (b);
+
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+static void
+npfrida_host_run_report (NPFridaHostRun * run, const gchar * scenario, gint64 elapsed)
+{
+  GArray * l = run->latencies;
+  gdouble sum = 0.0;
+  guint i;
+
+  if (l->len == 0)
+  {
+    gdouble none = 0.0;
+    g_array_append_val (l, none);
+  }
+
+  g_array_sort (l, npfrida_host_compare_latency);
+  for (i = 0; i != l->len; i++)
+    sum += g_array_index (l, gdouble, i);
+
+  g_print ("%-12s %-20s %8u %8u %10.1f %10.1f %10.1f %10.1f %10.1f %12.1f\n", scenario, run->method, run->completed, run->failed,
+      g_array_index (l, gdouble, 0),
+      sum / l->len,
+      g_array_index (l, gdouble, l->len / 2),
+      g_array_index (l, gdouble, MIN (l->len * 99 / 100, l->len - 1)),
+      g_array_index (l, gdouble, l->len - 1),
+      run->completed / (static_cast<gdouble> (MAX (elapsed, 1)) / G_USEC_PER_SEC));
+}
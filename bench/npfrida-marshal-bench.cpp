@@ -0,0 +1,397 @@
+#include "npfrida-host-browser.h"
+
+#include "npfrida.h"
+#include "npfrida-object-priv.h"
+#include "npfrida-plugin.h"
+
+#include <string.h>
+
+#define NPFRIDA_BENCH_MIN_DURATION (200 * G_TIME_SPAN_MILLISECOND)
+
+typedef struct _NPFridaBenchFixture NPFridaBenchFixture;
+typedef void (* NPFridaBenchFunc) (NPFridaBenchFixture * fixture, gconstpointer payload);
+
+struct _NPFridaBenchFixture
+{
+  NPP_t instance;
+  NPFridaObject * object;
+};
+
+/*
+ * Allocations are counted by interposing the C allocator. Only the benchmark
+ * thread counts, so frida's own threads do not skew the numbers.
+ */
+extern "C" void * __libc_malloc (size_t size);
+extern "C" void * __libc_calloc (size_t n, size_t size);
+extern "C" void * __libc_realloc (void * ptr, size_t size);
+
+static __thread gboolean npfrida_bench_counting = FALSE;
+static __thread guint64 npfrida_bench_allocations = 0;
+
+extern "C" void *
+malloc (size_t size)
+{
+  if (npfrida_bench_counting)
+    npfrida_bench_allocations++;
+  return __libc_malloc (size);
+}
+
+extern "C" void *
+calloc (size_t n, size_t size)
+{
+  if (npfrida_bench_counting)
+    npfrida_bench_allocations++;
+  return __libc_calloc (n, size);
+}
+
+extern "C" void *
+realloc (void * ptr, size_t size)
+{
+  if (npfrida_bench_counting)
+    npfrida_bench_allocations++;
+  return __libc_realloc (ptr, size);
+}
+
+static void
+npfrida_bench_run (NPFridaBenchFixture * fixture, const gchar * name, NPFridaBenchFunc func, gconstpointer payload)
+{
+  guint64 iterations = 0, batch = 1, allocations;
+  gint64 start_time, elapsed;
+  guint64 i;
+
+  /* Warm up caches and any lazily created state, such as interned identifiers */
+  func (fixture, payload);
+
+  npfrida_bench_allocations = 0;
+  start_time = g_get_monotonic_time ();
+  do
+  {
+    npfrida_bench_counting = TRUE;
+    for (i = 0; i != batch; i++)
+      func (fixture, payload);
+    npfrida_bench_counting = FALSE;
+
+    iterations += batch;
+    batch *= 2;
+    elapsed = g_get_monotonic_time () - start_time;
+  }
+  while (elapsed < NPFRIDA_BENCH_MIN_DURATION);
+  allocations = npfrida_bench_allocations;
+
+  g_print ("%-48s %12" G_GUINT64_FORMAT " %14.1f %12.1f\n", name, iterations,
+      (elapsed * 1000.0) / iterations,
+      static_cast<gdouble> (allocations) / iterations);
+}
+
+/* Payloads */
+
+static gchar *
+npfrida_bench_make_string (gsize length)
+{
+  gchar * str;
+
+  str = static_cast<gchar *> (g_malloc (length + 1));
+  memset (str, 'A', length);
+  str[length] = '\0';
+
+  return str;
+}
+
+static gchar *
+npfrida_bench_make_json_string (gsize length)
+{
+  gchar * body, * json;
+
+  body = npfrida_bench_make_string (length);
+  json = g_strdup_printf ("\"%s\"", body);
+  g_free (body);
+
+  return json;
+}
+
+static const gchar npfrida_bench_nested_json[] =
+    "{\"type\":\"send\",\"payload\":{\"name\":\"open\",\"args\":[1,2,3,\"/etc/hosts\"],"
+    "\"thread\":{\"id\":4242,\"state\":\"running\",\"context\":{\"pc\":\"0x7f00deadbeef\",\"sp\":\"0x7ffc00001000\"}}}}";
+
+static GVariant *
+npfrida_bench_make_bytes (gsize length)
+{
+  return g_variant_ref_sink (g_variant_new_from_data (G_VARIANT_TYPE ("ay"), g_malloc0 (length), length, TRUE, g_free, NULL));
+}
+
+static GVariant *
+npfrida_bench_make_processes (guint count)
+{
+  GVariantBuilder builder;
+  guint i;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("aa{sv}"));
+  for (i = 0; i != count; i++)
+  {
+    g_variant_builder_open (&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add (&builder, "{sv}", "pid", g_variant_new_uint32 (1000 + i));
+    g_variant_builder_add (&builder, "{sv}", "name", g_variant_new_string ("process"));
+    g_variant_builder_close (&builder);
+  }
+
+  return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+static NPObject *
+npfrida_bench_make_nested_object (void)
+{
+  NPObject * window = NULL, * json;
+  NPVariant variant, result;
+  NPNetscapeFuncs * browser = npfrida_host_browser_get_funcs ();
+
+  browser->getvalue (NULL, NPNVWindowNPObject, &window);
+  npfrida_host_get_property (window, "JSON", &variant);
+  json = NPVARIANT_TO_OBJECT (variant);
+
+  STRINGZ_TO_NPVARIANT (npfrida_bench_nested_json, variant);
+  browser->invoke (NULL, json, browser->getstringidentifier ("parse"), &variant, 1, &result);
+
+  browser->releaseobject (json);
+  browser->releaseobject (window);
+
+  return NPVARIANT_TO_OBJECT (result);
+}
+
+/* Benchmarks */
+
+static void
+npfrida_bench_argument_list (NPFridaBenchFixture * fixture, gconstpointer payload)
+{
+  const GArray * args = static_cast<const GArray *> (payload);
+  GVariant * arguments;
+
+  arguments = npfrida_object_argument_list_to_gvariant (fixture->object, reinterpret_cast<NPVariant *> (args->data), args->len, NULL);
+  g_variant_unref (arguments);
+}
+
+static void
+npfrida_bench_gvariant (NPFridaBenchFixture * fixture, gconstpointer payload)
+{
+  NPVariant result;
+
+  npfrida_object_gvariant_to_npvariant (fixture->object, static_cast<GVariant *> (const_cast<gpointer> (payload)), &result);
+  npfrida_nsfuncs->releasevariantvalue (&result);
+}
+
+static void
+npfrida_bench_gvalue (NPFridaBenchFixture * fixture, gconstpointer payload)
+{
+  NPVariant result;
+
+  npfrida_object_gvalue_to_npvariant (fixture->object, static_cast<const GValue *> (payload), &result);
+  npfrida_nsfuncs->releasevariantvalue (&result);
+}
+
+static void
+npfrida_bench_copy_npvariant (NPFridaBenchFixture * fixture, gconstpointer payload)
+{
+  NPVariant copy;
+
+  (void) fixture;
+
+  npfrida_init_npvariant_with_other (&copy, static_cast<const NPVariant *> (payload));
+  npfrida_nsfuncs->releasevariantvalue (&copy);
+}
+
+static void
+npfrida_bench_npstring (NPFridaBenchFixture * fixture, gconstpointer payload)
+{
+  (void) fixture;
+
+  g_free (npfrida_npstring_to_cstring (static_cast<const NPString *> (payload)));
+}
+
+static void
+npfrida_bench_run_argument_lists (NPFridaBenchFixture * fixture)
+{
+  GArray * args;
+  NPVariant arg;
+  gchar * kb, * mb;
+  NPObject * nested;
+
+  kb = npfrida_bench_make_string (1024);
+  mb = npfrida_bench_make_string (1024 * 1024);
+  nested = npfrida_bench_make_nested_object ();
+
+  args = g_array_new (FALSE, FALSE, sizeof (NPVariant));
+  INT32_TO_NPVARIANT (1, arg);
+  g_array_append_val (args, arg);
+  INT32_TO_NPVARIANT (1234, arg);
+  g_array_append_val (args, arg);
+  DOUBLE_TO_NPVARIANT (4294967295.0, arg);
+  g_array_append_val (args, arg);
+  npfrida_bench_run (fixture, "argument_list_to_gvariant/small-ints", npfrida_bench_argument_list, args);
+
+  g_array_set_size (args, 0);
+  STRINGZ_TO_NPVARIANT (kb, arg);
+  g_array_append_val (args, arg);
+  npfrida_bench_run (fixture, "argument_list_to_gvariant/string-1k", npfrida_bench_argument_list, args);
+
+  g_array_set_size (args, 0);
+  STRINGZ_TO_NPVARIANT (mb, arg);
+  g_array_append_val (args, arg);
+  npfrida_bench_run (fixture, "argument_list_to_gvariant/string-1m", npfrida_bench_argument_list, args);
+
+  g_array_set_size (args, 0);
+  OBJECT_TO_NPVARIANT (nested, arg);
+  g_array_append_val (args, arg);
+  npfrida_bench_run (fixture, "argument_list_to_gvariant/nested-object", npfrida_bench_argument_list, args);
+
+  g_array_free (args, TRUE);
+  npfrida_nsfuncs->releaseobject (nested);
+  g_free (mb);
+  g_free (kb);
+}
+
+static void
+npfrida_bench_run_gvariants (NPFridaBenchFixture * fixture)
+{
+  GVariant * value;
+  gchar * json;
+
+  value = g_variant_ref_sink (g_variant_new_uint32 (1234));
+  npfrida_bench_run (fixture, "gvariant_to_npvariant/uint32", npfrida_bench_gvariant, value);
+  g_variant_unref (value);
+
+  json = npfrida_bench_make_json_string (1024);
+  value = g_variant_ref_sink (g_variant_new_take_string (json));
+  npfrida_bench_run (fixture, "gvariant_to_npvariant/string-1k", npfrida_bench_gvariant, value);
+  g_variant_unref (value);
+
+  json = npfrida_bench_make_json_string (1024 * 1024);
+  value = g_variant_ref_sink (g_variant_new_take_string (json));
+  npfrida_bench_run (fixture, "gvariant_to_npvariant/string-1m", npfrida_bench_gvariant, value);
+  g_variant_unref (value);
+
+  value = g_variant_ref_sink (g_variant_new_string (npfrida_bench_nested_json));
+  npfrida_bench_run (fixture, "gvariant_to_npvariant/nested-object", npfrida_bench_gvariant, value);
+  g_variant_unref (value);
+
+  value = npfrida_bench_make_processes (200);
+  npfrida_bench_run (fixture, "gvariant_to_npvariant/aa{sv}-200", npfrida_bench_gvariant, value);
+  g_variant_unref (value);
+}
+
+static void
+npfrida_bench_run_gvalues (NPFridaBenchFixture * fixture)
+{
+  GValue value = G_VALUE_INIT;
+  GVariant * bytes;
+
+  g_value_init (&value, G_TYPE_UINT);
+  g_value_set_uint (&value, 1234);
+  npfrida_bench_run (fixture, "gvalue_to_npvariant/uint", npfrida_bench_gvalue, &value);
+  g_value_unset (&value);
+
+  g_value_init (&value, G_TYPE_STRING);
+  g_value_take_string (&value, npfrida_bench_make_json_string (1024));
+  npfrida_bench_run (fixture, "gvalue_to_npvariant/string-1k", npfrida_bench_gvalue, &value);
+  g_value_unset (&value);
+
+  g_value_init (&value, G_TYPE_STRING);
+  g_value_set_static_string (&value, npfrida_bench_nested_json);
+  npfrida_bench_run (fixture, "gvalue_to_npvariant/nested-object", npfrida_bench_gvalue, &value);
+  g_value_unset (&value);
+
+  bytes = npfrida_bench_make_bytes (1024);
+  g_value_init (&value, G_TYPE_VARIANT);
+  g_value_set_variant (&value, bytes);
+  npfrida_bench_run (fixture, "gvalue_to_npvariant/ay-1k", npfrida_bench_gvalue, &value);
+  g_value_unset (&value);
+  g_variant_unref (bytes);
+
+  bytes = npfrida_bench_make_bytes (1024 * 1024);
+  g_value_init (&value, G_TYPE_VARIANT);
+  g_value_set_variant (&value, bytes);
+  npfrida_bench_run (fixture, "gvalue_to_npvariant/ay-1m", npfrida_bench_gvalue, &value);
+  g_value_unset (&value);
+  g_variant_unref (bytes);
+}
+
+static void
+npfrida_bench_run_copies (NPFridaBenchFixture * fixture)
+{
+  NPVariant value;
+  NPString str;
+  gchar * kb, * mb;
+  NPObject * nested;
+
+  kb = npfrida_bench_make_string (1024);
+  mb = npfrida_bench_make_string (1024 * 1024);
+  nested = npfrida_bench_make_nested_object ();
+
+  INT32_TO_NPVARIANT (1234, value);
+  npfrida_bench_run (fixture, "init_npvariant_with_other/int32", npfrida_bench_copy_npvariant, &value);
+
+  STRINGZ_TO_NPVARIANT (kb, value);
+  npfrida_bench_run (fixture, "init_npvariant_with_other/string-1k", npfrida_bench_copy_npvariant, &value);
+
+  STRINGZ_TO_NPVARIANT (mb, value);
+  npfrida_bench_run (fixture, "init_npvariant_with_other/string-1m", npfrida_bench_copy_npvariant, &value);
+
+  OBJECT_TO_NPVARIANT (nested, value);
+  npfrida_bench_run (fixture, "init_npvariant_with_other/object", npfrida_bench_copy_npvariant, &value);
+
+  str.UTF8Characters = kb;
+  str.UTF8Length = 1024;
+  npfrida_bench_run (fixture, "npstring_to_cstring/string-1k", npfrida_bench_npstring, &str);
+
+  str.UTF8Characters = mb;
+  str.UTF8Length = 1024 * 1024;
+  npfrida_bench_run (fixture, "npstring_to_cstring/string-1m", npfrida_bench_npstring, &str);
+
+  npfrida_nsfuncs->releaseobject (nested);
+  g_free (mb);
+  g_free (kb);
+}
+
+int
+main (int argc, char * argv[])
+{
+  NPFridaBenchFixture fixture;
+  NPPluginFuncs plugin_funcs;
+  NPFridaNPObject * root = NULL;
+  const gchar * filter;
+
+  filter = (argc > 1) ? argv[1] : NULL;
+
+  /* Route GSlice through malloc so that slab allocations are counted too */
+  g_setenv ("G_SLICE", "always-malloc", TRUE);
+
+  npfrida_host_browser_init ();
+
+  memset (&plugin_funcs, 0, sizeof (plugin_funcs));
+  plugin_funcs.size = sizeof (plugin_funcs);
+  NP_Initialize (npfrida_host_browser_get_funcs (), &plugin_funcs);
+
+  memset (&fixture, 0, sizeof (fixture));
+  plugin_funcs.newp (const_cast<char *> ("application/x-vnd-frida"), &fixture.instance, NP_EMBED, 0, NULL, NULL, NULL);
+  plugin_funcs.getvalue (&fixture.instance, NPPVpluginScriptableNPObject, &root);
+  fixture.object = root->g_object;
+
+  g_print ("%-48s %12s %14s %12s\n", "benchmark", "iterations", "ns/op", "allocs/op");
+
+  if (filter == NULL || strstr ("argument_list_to_gvariant", filter) != NULL)
+    npfrida_bench_run_argument_lists (&fixture);
+  if (filter == NULL || strstr ("gvariant_to_npvariant", filter) != NULL)
+    npfrida_bench_run_gvariants (&fixture);
+  if (filter == NULL || strstr ("gvalue_to_npvariant", filter) != NULL)
+    npfrida_bench_run_gvalues (&fixture);
+  if (filter == NULL || strstr ("init_npvariant_with_other npstring_to_cstring", filter) != NULL)
+    npfrida_bench_run_copies (&fixture);
+
+  npfrida_nsfuncs->releaseobject (&root->np_object);
+  plugin_funcs.destroy (&fixture.instance, NULL);
+  while (npfrida_host_browser_iterate (10000))
+    ;
+  NP_Shutdown ();
+
+  npfrida_host_browser_deinit ();
+
+  return 0;
+}
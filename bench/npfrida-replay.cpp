@@ -0,0 +1,531 @@
+#include "npfrida-replay.h"
+
+#include "npfrida-record.h"
+
+#include <string.h>
+
+#define NPFRIDA_REPLAY_ERROR (g_quark_from_static_string ("npfrida-replay-error"))
+#define NPFRIDA_REPLAY_DRAIN_TIMEOUT (10 * G_USEC_PER_SEC)
+
+typedef struct _NPFridaReplay NPFridaReplay;
+typedef struct _NPFridaReplayReader NPFridaReplayReader;
+typedef struct _NPFridaReplayMethod NPFridaReplayMethod;
+typedef struct _NPFridaReplayPending NPFridaReplayPending;
+
+struct _NPFridaReplayReader
+{
+  const guint8 * cursor;
+  const guint8 * end;
+  gboolean failed;
+};
+
+struct _NPFridaReplay
+{
+  NPP instance;
+  NPObject * root;
+  NPObject * json;
+  GHashTable * objects;
+  GHashTable * methods;
+  GPtrArray * method_order;
+  guint outstanding;
+  guint skipped;
+};
+
+struct _NPFridaReplayMethod
+{
+  gchar * name;
+  guint calls;
+  guint exceptions;
+  gint64 recorded_total;
+  gint64 replayed_total;
+  GArray * completions;
+};
+
+struct _NPFridaReplayPending
+{
+  NPFridaReplay * replay;
+  NPFridaReplayMethod * method;
+  gint64 start_time;
+};
+
+static gboolean npfrida_replay_step (NPFridaReplay * self, NPFridaReplayReader * reader, gint64 * offset, gint64 replay_start, gdouble speed);
+static void npfrida_replay_read_arg (NPFridaReplay * self, NPFridaReplayReader * reader, NPVariant * value, GPtrArray * owned);
+static void npfrida_replay_watch (NPFridaReplay * self, NPFridaReplayMethod * method, NPObject * promise, gint64 start_time);
+static void npfrida_replay_on_complete (const NPVariant * args, uint32_t arg_count, NPVariant * result, gpointer user_data);
+static void npfrida_replay_on_callback (const NPVariant * args, uint32_t arg_count, NPVariant * result, gpointer user_data);
+static NPFridaReplayMethod * npfrida_replay_get_method (NPFridaReplay * self, NPFridaRecordKind kind, const gchar * name, gsize length);
+static void npfrida_replay_method_free (gpointer data);
+static void npfrida_replay_release_object (gpointer data);
+static void npfrida_replay_report (NPFridaReplay * self, gint64 recorded, gint64 replayed);
+
+static guint8 npfrida_replay_read_u8 (NPFridaReplayReader * reader);
+static guint64 npfrida_replay_read_varint (NPFridaReplayReader * reader);
+static const gchar * npfrida_replay_read_string (NPFridaReplayReader * reader, gsize * length);
+
+gboolean
+npfrida_replay_run (NPP instance, NPObject * root, const gchar * path, gdouble speed, GError ** error)
+{
+  NPNetscapeFuncs * browser = npfrida_host_browser_get_funcs ();
+  NPFridaReplay * replay;
+  NPFridaReplayReader reader;
+  NPObject * window = NULL;
+  NPVariant json;
+  gchar * contents;
+  gsize length;
+  gint64 offset = 0, replay_start, deadline;
+  gboolean success = TRUE;
+
+  if (!g_file_get_contents (path, &contents, &length, error))
+    return FALSE;
+
+  if (length < NPFRIDA_RECORD_MAGIC_SIZE || memcmp (contents, NPFRIDA_RECORD_MAGIC, NPFRIDA_RECORD_MAGIC_SIZE) != 0)
+  {
+    g_set_error (error, NPFRIDA_REPLAY_ERROR, 0, "%s is not a recording", path);
+    g_free (contents);
+    return FALSE;
+  }
+
+  reader.cursor = reinterpret_cast<const guint8 *> (contents) + NPFRIDA_RECORD_MAGIC_SIZE;
+  reader.end = reinterpret_cast<const guint8 *> (contents) + length;
+  reader.failed = FALSE;
+
+  browser->getvalue (instance, NPNVWindowNPObject, &window);
+  npfrida_host_get_property (window, "JSON", &json);
+  browser->releaseobject (window);
+
+  replay = g_slice_new (NPFridaReplay);
+  replay->instance = instance;
+  replay->root = root;
+  replay->json = NPVARIANT_TO_OBJECT (json);
+  replay->objects = g_hash_table_new_full (NULL, NULL, NULL, npfrida_replay_release_object);
+  replay->methods = g_hash_table_new (g_str_hash, g_str_equal);
+  replay->method_order = g_ptr_array_new_with_free_func (npfrida_replay_method_free);
+  replay->outstanding = 0;
+  replay->skipped = 0;
+
+  replay_start = g_get_monotonic_time ();
+  while (success && reader.cursor != reader.end)
+    success = npfrida_replay_step (replay, &reader, &offset, replay_start, speed);
+  if (!success)
+    g_set_error (error, NPFRIDA_REPLAY_ERROR, 0, "%s is truncated or corrupt", path);
+
+  deadline = g_get_monotonic_time () + NPFRIDA_REPLAY_DRAIN_TIMEOUT;
+  while (replay->outstanding != 0 && g_get_monotonic_time () < deadline)
+    npfrida_host_browser_iterate (deadline - g_get_monotonic_time ());
+
+  npfrida_replay_report (replay, offset, g_get_monotonic_time () - replay_start);
+
+  /* Calls that never completed still point at the replay from their callbacks, so it is leaked */
+  if (replay->outstanding == 0)
+  {
+    g_hash_table_unref (replay->objects);
+    g_hash_table_unref (replay->methods);
+    g_ptr_array_unref (replay->method_order);
+    browser->releaseobject (replay->json);
+    g_slice_free (NPFridaReplay, replay);
+    g_free (contents);
+  }
+
+  return success;
+}
+
+static gboolean
+npfrida_replay_step (NPFridaReplay * self, NPFridaReplayReader * reader, gint64 * offset, gint64 replay_start, gdouble speed)
+{
+  NPNetscapeFuncs * browser = npfrida_host_browser_get_funcs ();
+  NPFridaRecordKind kind;
+  NPFridaReplayMethod * method;
+  guint64 duration, target_handle, arg_count, i;
+  const gchar * name;
+  gsize name_length;
+  gchar * name_str;
+  NPObject * target;
+  NPVariant * args, result;
+  GPtrArray * owned;
+  guint8 result_tag;
+  guint new_handle = 0;
+  gint64 start_time;
+  gchar * exception;
+
+  kind = npfrida_replay_read_u8 (reader);
+  *offset += npfrida_replay_read_varint (reader);
+  duration = npfrida_replay_read_varint (reader);
+  target_handle = npfrida_replay_read_varint (reader);
+  name = npfrida_replay_read_string (reader, &name_length);
+  arg_count = npfrida_replay_read_varint (reader);
+  if (reader->failed || arg_count > static_cast<guint64> (reader->end - reader->cursor))
+    return FALSE;
+
+  owned = g_ptr_array_new_with_free_func (reinterpret_cast<GDestroyNotify> (browser->releaseobject));
+  args = g_new0 (NPVariant, MAX (arg_count, 1));
+  for (i = 0; i != arg_count; i++)
+    npfrida_replay_read_arg (self, reader, &args[i], owned);
+
+  /* Only plugin objects matter in the result, other values are skipped */
+  result_tag = npfrida_replay_read_u8 (reader);
+  switch (result_tag)
+  {
+    case NPFRIDA_RECORD_INT32:
+    case NPFRIDA_RECORD_OBJECT:
+      npfrida_replay_read_varint (reader);
+      break;
+    case NPFRIDA_RECORD_NEW_OBJECT:
+      new_handle = npfrida_replay_read_varint (reader);
+      break;
+    case NPFRIDA_RECORD_DOUBLE:
+      if (reader->end - reader->cursor < 8)
+        reader->failed = TRUE;
+      else
+        reader->cursor += 8;
+      break;
+    case NPFRIDA_RECORD_STRING:
+    case NPFRIDA_RECORD_JSON:
+    {
+      gsize length;
+      npfrida_replay_read_string (reader, &length);
+      break;
+    }
+    default:
+      break;
+  }
+  if (reader->failed)
+  {
+    g_free (args);
+    g_ptr_array_unref (owned);
+    return FALSE;
+  }
+
+  /* Keep the recorded pacing, unless replaying as fast as possible */
+  if (speed > 0)
+  {
+    gint64 due = replay_start + static_cast<gint64> (*offset / speed);
+    while (g_get_monotonic_time () < due)
+      npfrida_host_browser_iterate (due - g_get_monotonic_time ());
+  }
+  while (npfrida_host_browser_iterate (0))
+    ;
+
+  method = npfrida_replay_get_method (self, kind, name, name_length);
+
+  if (!g_hash_table_lookup_extended (self->objects, GUINT_TO_POINTER (target_handle), NULL, reinterpret_cast<gpointer *> (&target)))
+  {
+    target = browser->retainobject (self->root);
+    g_hash_table_insert (self->objects, GUINT_TO_POINTER (target_handle), target);
+  }
+
+  if (target == NULL)
+  {
+    self->skipped++;
+  }
+  else
+  {
+    name_str = g_strndup (name, name_length);
+    VOID_TO_NPVARIANT (result);
+
+    start_time = g_get_monotonic_time ();
+    if (kind == NPFRIDA_RECORD_GET_PROPERTY)
+      browser->getproperty (self->instance, target, browser->getstringidentifier (name_str), &result);
+    else
+      browser->invoke (self->instance, target, browser->getstringidentifier (name_str), args, arg_count, &result);
+    method->replayed_total += g_get_monotonic_time () - start_time;
+    method->recorded_total += duration;
+    method->calls++;
+
+    exception = npfrida_host_browser_take_exception ();
+    if (exception != NULL)
+      method->exceptions++;
+    g_free (exception);
+
+    if (new_handle != 0)
+    {
+      NPObject * obj = NULL;
+
+      if (NPVARIANT_IS_OBJECT (result))
+      {
+        obj = browser->retainobject (NPVARIANT_TO_OBJECT (result));
+        if (browser->hasmethod (self->instance, obj, browser->getstringidentifier ("always")))
+          npfrida_replay_watch (self, method, obj, start_time);
+      }
+      g_hash_table_insert (self->objects, GUINT_TO_POINTER (new_handle), obj);
+    }
+
+    browser->releasevariantvalue (&result);
+    g_free (name_str);
+  }
+
+  g_free (args);
+  g_ptr_array_unref (owned);
+
+  return TRUE;
+}
+
+static void
+npfrida_replay_read_arg (NPFridaReplay * self, NPFridaReplayReader * reader, NPVariant * value, GPtrArray * owned)
+{
+  NPNetscapeFuncs * browser = npfrida_host_browser_get_funcs ();
+  const gchar * str;
+  gsize length;
+
+  VOID_TO_NPVARIANT (*value);
+
+  switch (npfrida_replay_read_u8 (reader))
+  {
+    case NPFRIDA_RECORD_VOID:
+      break;
+    case NPFRIDA_RECORD_NULL:
+      NULL_TO_NPVARIANT (*value);
+      break;
+    case NPFRIDA_RECORD_FALSE:
+      BOOLEAN_TO_NPVARIANT (false, *value);
+      break;
+    case NPFRIDA_RECORD_TRUE:
+      BOOLEAN_TO_NPVARIANT (true, *value);
+      break;
+    case NPFRIDA_RECORD_INT32:
+    {
+      guint32 v = npfrida_replay_read_varint (reader);
+      INT32_TO_NPVARIANT (static_cast<int32_t> ((v >> 1) ^ -(v & 1)), *value);
+      break;
+    }
+    case NPFRIDA_RECORD_DOUBLE:
+    {
+      guint64 bits;
+      gdouble v;
+
+      if (reader->end - reader->cursor < 8)
+      {
+        reader->failed = TRUE;
+        break;
+      }
+      memcpy (&bits, reader->cursor, sizeof (bits));
+      reader->cursor += sizeof (bits);
+      bits = GUINT64_FROM_LE (bits);
+      memcpy (&v, &bits, sizeof (v));
+      DOUBLE_TO_NPVARIANT (v, *value);
+      break;
+    }
+    case NPFRIDA_RECORD_STRING:
+      /* Points into the recording, the plugin copies what it keeps */
+      str = npfrida_replay_read_string (reader, &length);
+      if (str != NULL)
+        STRINGN_TO_NPVARIANT (str, length, *value);
+      break;
+    case NPFRIDA_RECORD_JSON:
+    {
+      NPVariant text;
+
+      str = npfrida_replay_read_string (reader, &length);
+      if (str == NULL)
+        break;
+      STRINGN_TO_NPVARIANT (str, length, text);
+      browser->invoke (self->instance, self->json, browser->getstringidentifier ("parse"), &text, 1, value);
+      if (NPVARIANT_IS_OBJECT (*value))
+        g_ptr_array_add (owned, NPVARIANT_TO_OBJECT (*value));
+      break;
+    }
+    case NPFRIDA_RECORD_FUNCTION:
+    {
+      NPObject * callback = npfrida_host_function_new (npfrida_replay_on_callback, NULL);
+      g_ptr_array_add (owned, callback);
+      OBJECT_TO_NPVARIANT (callback, *value);
+      break;
+    }
+    case NPFRIDA_RECORD_OBJECT:
+    {
+      NPObject * obj;
+
+      obj = static_cast<NPObject *> (g_hash_table_lookup (self->objects, GUINT_TO_POINTER (npfrida_replay_read_varint (reader))));
+      if (obj != NULL)
+        OBJECT_TO_NPVARIANT (obj, *value);
+      else
+        NULL_TO_NPVARIANT (*value);
+      break;
+    }
+    default:
+      reader->failed = TRUE;
+      break;
+  }
+}
+
+static void
+npfrida_replay_watch (NPFridaReplay * self, NPFridaReplayMethod * method, NPObject * promise, gint64 start_time)
+{
+  NPNetscapeFuncs * browser = npfrida_host_browser_get_funcs ();
+  NPFridaReplayPending * pending;
+  NPObject * callback;
+  NPVariant arg, result;
+
+  pending = g_slice_new (NPFridaReplayPending);
+  pending->replay = self;
+  pending->method = method;
+  pending->start_time = start_time;
+  self->outstanding++;
+
+  callback = npfrida_host_function_new (npfrida_replay_on_complete, pending);
+  OBJECT_TO_NPVARIANT (callback, arg);
+  browser->invoke (self->instance, promise, browser->getstringidentifier ("always"), &arg, 1, &result);
+  browser->releasevariantvalue (&result);
+  browser->releaseobject (callback);
+}
+
+static void
+npfrida_replay_on_complete (const NPVariant * args, uint32_t arg_count, NPVariant * result, gpointer user_data)
+{
+  NPFridaReplayPending * pending = static_cast<NPFridaReplayPending *> (user_data);
+  gdouble latency;
+
+  (void) args;
+  (void) arg_count;
+  (void) result;
+
+  latency = static_cast<gdouble> (g_get_monotonic_time () - pending->start_time);
+  g_array_append_val (pending->method->completions, latency);
+  pending->replay->outstanding--;
+
+  g_slice_free (NPFridaReplayPending, pending);
+}
+
+static void
+npfrida_replay_on_callback (const NPVariant * args, uint32_t arg_count, NPVariant * result, gpointer user_data)
+{
+  (void) args;
+  (void) arg_count;
+  (void) result;
+  (void) user_data;
+}
+
+static NPFridaReplayMethod *
+npfrida_replay_get_method (NPFridaReplay * self, NPFridaRecordKind kind, const gchar * name, gsize length)
+{
+  NPFridaReplayMethod * method;
+  gchar * key;
+
+  key = g_strdup_printf ("%s%.*s", (kind == NPFRIDA_RECORD_GET_PROPERTY) ? "." : "", static_cast<gint> (length), name);
+  method = static_cast<NPFridaReplayMethod *> (g_hash_table_lookup (self->methods, key));
+  if (method != NULL)
+  {
+    g_free (key);
+    return method;
+  }
+
+  method = g_slice_new0 (NPFridaReplayMethod);
+  method->name = key;
+  method->completions = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  g_hash_table_insert (self->methods, method->name, method);
+  g_ptr_array_add (self->method_order, method);
+
+  return method;
+}
+
+static void
+npfrida_replay_method_free (gpointer data)
+{
+  NPFridaReplayMethod * method = static_cast<NPFridaReplayMethod *> (data);
+
+  g_array_free (method->completions, TRUE);
+  g_free (method->name);
+  g_slice_free (NPFridaReplayMethod, method);
+}
+
+static void
+npfrida_replay_release_object (gpointer data)
+{
+  if (data != NULL)
+    npfrida_host_browser_get_funcs ()->releaseobject (static_cast<NPObject *> (data));
+}
+
+static gint
+npfrida_replay_compare_latency (gconstpointer a, gconstpointer b)
+{
+  gdouble lhs = *static_cast<const gdouble *> (a), rhs = *static_cast<const gdouble *> (b);
+
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+static void
+npfrida_replay_report (NPFridaReplay * self, gint64 recorded, gint64 replayed)
+{
+  guint i;
+
+  g_print ("%-24s %8s %8s %14s %14s %12s %12s\n", "method", "calls", "thrown",
+      "recorded(us)", "replayed(us)", "p50(us)", "p99(us)");
+
+  for (i = 0; i != self->method_order->len; i++)
+  {
+    NPFridaReplayMethod * method = static_cast<NPFridaReplayMethod *> (g_ptr_array_index (self->method_order, i));
+    GArray * l = method->completions;
+    guint calls = MAX (method->calls, 1);
+
+    g_array_sort (l, npfrida_replay_compare_latency);
+
+    g_print ("%-24s %8u %8u %14.1f %14.1f", method->name, method->calls, method->exceptions,
+        static_cast<gdouble> (method->recorded_total) / calls,
+        static_cast<gdouble> (method->replayed_total) / calls);
+    if (l->len != 0)
+    {
+      g_print (" %12.1f %12.1f\n",
+          g_array_index (l, gdouble, l->len / 2),
+          g_array_index (l, gdouble, MIN (l->len * 99 / 100, l->len - 1)));
+    }
+    else
+    {
+      g_print (" %12s %12s\n", "-", "-");
+    }
+  }
+
+  g_print ("\nrecorded span %.3f s, replayed in %.3f s, %u calls skipped, %u still pending\n",
+      recorded / static_cast<gdouble> (G_USEC_PER_SEC), replayed / static_cast<gdouble> (G_USEC_PER_SEC),
+      self->skipped, self->outstanding);
+}
+
+static guint8
+npfrida_replay_read_u8 (NPFridaReplayReader * reader)
+{
+  if (reader->cursor == reader->end)
+  {
+    reader->failed = TRUE;
+    return 0;
+  }
+
+  return *reader->cursor++;
+}
+
+static guint64
+npfrida_replay_read_varint (NPFridaReplayReader * reader)
+{
+  guint64 value = 0;
+  guint shift = 0;
+  guint8 b;
+
+  do
+  {
+    b = npfrida_replay_read_u8 (reader);
+    if (shift < 64)
+      value |= static_cast<guint64> (b & 0x7f) << shift;
+    shift += 7;
+  }
+  while ((b & 0x80) != 0 && !reader->failed);
+
+  return value;
+}
+
+static const gchar *
+npfrida_replay_read_string (NPFridaReplayReader * reader, gsize * length)
+{
+  const gchar * str;
+  guint64 n;
+
+  n = npfrida_replay_read_varint (reader);
+  if (reader->failed || n > static_cast<guint64> (reader->end - reader->cursor))
+  {
+    reader->failed = TRUE;
+    *length = 0;
+    return NULL;
+  }
+
+  str = reinterpret_cast<const gchar *> (reader->cursor);
+  reader->cursor += n;
+  *length = n;
+
+  return str;
+}
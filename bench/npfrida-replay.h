@@ -0,0 +1,12 @@
+#ifndef __NPFRIDA_REPLAY_H__
+#define __NPFRIDA_REPLAY_H__
+
+#include "npfrida-host-browser.h"
+
+G_BEGIN_DECLS
+
+gboolean npfrida_replay_run (NPP instance, NPObject * root, const gchar * path, gdouble speed, GError ** error);
+
+G_END_DECLS
+
+#endif
@@ -1,150 +1,330 @@
 namespace NPFrida {
+	/* Never exported on a bus, the annotation only makes valac emit introspection data for the stub check */
 	[DBus (name = "com.appspot.npfrida.RootApi")]
 	public interface RootApi : Object {
-		public abstract async string enumerate_devices () throws Error;
-		public abstract async string enumerate_processes (uint device_id) throws Error;
-		public abstract async void attach_to (uint device_id, uint pid, string source) throws Error;
-		public abstract async void post_message (uint device_id, uint pid, string message) throws Error;
-		public abstract async void detach_from (uint device_id, uint pid) throws Error;
+		public abstract async Variant enumerate_devices (Cancellable? cancellable = null) throws Error;
+		public abstract async Variant enumerate_processes (uint device_id, Cancellable? cancellable = null) throws Error;
+		public abstract async void attach_to (uint device_id, uint pid, string source, Cancellable? cancellable = null) throws Error;
+		public abstract async void post_message (uint device_id, uint pid, string message, Cancellable? cancellable = null) throws Error;
+		public abstract async void detach_from (uint device_id, uint pid, Cancellable? cancellable = null) throws Error;
 
 		public signal void devices_changed ();
 		public signal void detach (uint device_id, uint pid);
 		public signal void message (uint device_id, uint pid, string text, Variant? data);
 	}
 
-	public class Dispatcher : GLib.Object {
-		protected unowned NPFrida.Object target_object;
-		protected DBusMethodInfo ** methods;
-		protected DBusInterfaceMethodCallFunc dispatch_func;
+	/*
+	 * Hand-written stubs, one per RootApi method. Each one keeps the name
+	 * exposed to pages, the signature its arguments are coerced to and the
+	 * typed call together, so adding a method means adding one stub here.
+	 * check_root_api_stubs () holds them against the interface.
+	 */
+	internal abstract class MethodStub : GLib.Object {
+		/* Interned, so it can be handed to the tracer and outlive the stub */
+		public unowned string name;
+		public string signature;
 
-		public Dispatcher.for_object (NPFrida.Object obj) {
-			init_with_object (obj);
+		protected MethodStub (string name, string signature) {
+			this.name = name.intern ();
+			this.signature = signature;
 		}
 
-		private extern void init_with_object (NPFrida.Object obj);
+		public abstract async Variant? call (RootApi api, Variant[] args, Cancellable? cancellable) throws Error;
+	}
 
-		public bool has_method (string name) {
-			return find_method_by_name (name) != null;
+	private MethodStub[] create_root_api_stubs () {
+		MethodStub[] stubs = {
+			new EnumerateDevicesStub (),
+			new EnumerateProcessesStub (),
+			new AttachToStub (),
+			new PostMessageStub (),
+			new DetachFromStub ()
+		};
+		check_root_api_stubs (stubs);
+		return stubs;
+	}
+
+	/*
+	 * Every RootApi method must have exactly one stub, named like its D-Bus
+	 * member with a lowercase first letter and taking the same in-arguments.
+	 * A method added to or changed in the interface without a matching stub
+	 * aborts on the first dispatcher rather than misbehaving on some call.
+	 */
+	private void check_root_api_stubs (MethodStub[] stubs) {
+		unowned DBusInterfaceInfo info = (DBusInterfaceInfo) typeof (RootApi).get_qdata (Quark.from_string ("vala-dbus-interface-info"));
+		assert (info != null);
+		assert (info.methods.length == stubs.length);
+
+		foreach (var stub in stubs) {
+			var dbus_name = new StringBuilder ();
+			dbus_name.append_unichar (stub.name[0].toupper ());
+			dbus_name.append (stub.name.substring (1));
+
+			unowned DBusMethodInfo? method = info.lookup_method (dbus_name.str);
+			assert (method != null);
+
+			var signature = new StringBuilder ("(");
+			foreach (var arg in method.in_args)
+				signature.append (arg.signature);
+			signature.append_c (')');
+			assert (signature.str == stub.signature);
 		}
+	}
 
-		public void validate_invoke (string name, Variant? args) throws IOError {
-			var method = find_method_by_name (name);
-			if (method == null)
-				throw new IOError.NOT_FOUND ("no such method");
+	private class EnumerateDevicesStub : MethodStub {
+		public EnumerateDevicesStub () {
+			base ("enumerateDevices", "()");
+		}
 
-			validate_argument_list (args, method);
+		public override async Variant? call (RootApi api, Variant[] args, Cancellable? cancellable) throws Error {
+			return yield api.enumerate_devices (cancellable);
 		}
+	}
 
-		public async Variant? invoke (string name, Variant? args) throws IOError {
-			var method = find_method_by_name (name);
-			var parameters_in = coerce_argument_list (args, method);
-			var parameters_out = yield do_invoke (method, parameters_in);
-			assert (parameters_out.n_children () <= 1);
-			if (parameters_out.n_children () == 0)
-				return null;
-			return parameters_out.get_child_value (0);
+	private class EnumerateProcessesStub : MethodStub {
+		public EnumerateProcessesStub () {
+			base ("enumerateProcesses", "(u)");
 		}
 
-		private extern async Variant? do_invoke (DBusMethodInfo * method, Variant parameters) throws IOError;
+		public override async Variant? call (RootApi api, Variant[] args, Cancellable? cancellable) throws Error {
+			return yield api.enumerate_processes (args[0].get_uint32 (), cancellable);
+		}
+	}
 
-		private DBusMethodInfo * find_method_by_name (string name) {
-			if (name.length == 0)
-				return null;
+	private class AttachToStub : MethodStub {
+		public AttachToStub () {
+			base ("attachTo", "(uus)");
+		}
 
-			var dbus_name = new StringBuilder ();
-			dbus_name.append_unichar (name[0].toupper ());
-			dbus_name.append (name.substring (1));
+		public override async Variant? call (RootApi api, Variant[] args, Cancellable? cancellable) throws Error {
+			yield api.attach_to (args[0].get_uint32 (), args[1].get_uint32 (), args[2].get_string (), cancellable);
+			return null;
+		}
+	}
 
-			for (DBusMethodInfo ** method = methods; *method != null; method++) {
-				if ((*method)->name == dbus_name.str)
-					return *method;
-			}
+	private class PostMessageStub : MethodStub {
+		public PostMessageStub () {
+			base ("postMessage", "(uus)");
+		}
 
+		public override async Variant? call (RootApi api, Variant[] args, Cancellable? cancellable) throws Error {
+			yield api.post_message (args[0].get_uint32 (), args[1].get_uint32 (), args[2].get_string (), cancellable);
 			return null;
 		}
+	}
 
-		private void validate_argument_list (Variant args, DBusMethodInfo * method) throws IOError {
-			var actual_arg_count = (int) args.n_children ();
-			var expected_arg_count = method->in_args.length;
-			if (actual_arg_count != expected_arg_count)
-				throw new IOError.INVALID_ARGUMENT ("argument count mismatch");
+	private class DetachFromStub : MethodStub {
+		public DetachFromStub () {
+			base ("detachFrom", "(uu)");
+		}
 
-			for (var i = 0; i != expected_arg_count; i++) {
-				var arg = args.get_child_value (i);
+		public override async Variant? call (RootApi api, Variant[] args, Cancellable? cancellable) throws Error {
+			yield api.detach_from (args[0].get_uint32 (), args[1].get_uint32 (), cancellable);
+			return null;
+		}
+	}
 
-				var actual_type = arg.get_type ();
-				var expected_type = new VariantType (method->in_args[i].signature);
+	/* Coerced arguments bound to their stub, handed from the browser thread to the frida thread */
+	public class PreparedCall : GLib.Object {
+		internal MethodStub stub;
+		internal Variant[] args;
 
-				bool types_are_compatible;
-				if (actual_type.equal (expected_type))
-					types_are_compatible = true;
-				else
-					types_are_compatible = is_numeric (expected_type) && is_numeric (actual_type);
+		internal PreparedCall (MethodStub stub, owned Variant[] args) {
+			this.stub = stub;
+			this.args = (owned) args;
+		}
 
-				if (!types_are_compatible)
-					throw new IOError.INVALID_ARGUMENT ("argument type mismatch");
-			}
+		public unowned string get_name () {
+			return stub.name;
 		}
+	}
 
-		private Variant coerce_argument_list (Variant args, DBusMethodInfo * method) {
-			var builder = new VariantBuilder (VariantType.TUPLE);
-			var i = 0;
-			foreach (var ai in method->in_args) {
-				var arg = args.get_child_value (i);
-
-				var actual_type = arg.get_type ();
-				var expected_type = new VariantType (method->in_args[i].signature);
-
-				Variant coerced_arg;
-				if (actual_type.equal (expected_type)) {
-					coerced_arg = arg;
-				} else {
-					var val = double.parse (arg.print (false));
-					if (expected_type.equal (VariantType.INT32))
-						coerced_arg = new Variant.int32 ((int32) val);
-					else if (expected_type.equal (VariantType.UINT32))
-						coerced_arg = new Variant.uint32 ((uint32) val);
-					else if (expected_type.equal (VariantType.DOUBLE))
-						coerced_arg = new Variant.double (val);
-					else if (expected_type.equal (VariantType.INT64))
-						coerced_arg = new Variant.int64 ((int64) val);
-					else if (expected_type.equal (VariantType.UINT64))
-						coerced_arg = new Variant.uint64 ((uint64) val);
-					else if (expected_type.equal (VariantType.INT16))
-						coerced_arg = new Variant.int16 ((int16) val);
-					else if (expected_type.equal (VariantType.UINT16))
-						coerced_arg = new Variant.uint16 ((uint16) val);
-					else if (expected_type.equal (VariantType.BYTE))
-						coerced_arg = new Variant.byte ((uchar) val);
-					else
-						assert_not_reached ();
-				}
-				builder.add_value (coerced_arg);
+	public class Dispatcher : GLib.Object {
+		private unowned RootApi api;
 
-				i++;
+		private HashTable<string, CallPlan> plans = new HashTable<string, CallPlan> (str_hash, str_equal);
+
+		public Dispatcher.for_object (NPFrida.Object obj) {
+			if (obj is RootApi)
+				api = obj as RootApi;
+			else
+				assert_not_reached ();
+
+			foreach (var stub in create_root_api_stubs ())
+				plans[stub.name] = new CallPlan (stub);
+		}
+
+		public bool has_method (string name) {
+			return plans.contains (name);
+		}
+
+		public int get_arity (string name) {
+			var plan = plans[name];
+			if (plan == null)
+				return -1;
+			return plan.coercions.length;
+		}
+
+		public PreparedCall prepare_invoke (string name, Variant args) throws IOError {
+			var plan = plans[name];
+			if (plan == null)
+				throw new IOError.NOT_FOUND ("no such method");
+
+			return new PreparedCall (plan.stub, plan.coerce_argument_list (args));
+		}
+
+		public async Variant? invoke (PreparedCall call, Cancellable? cancellable) throws Error {
+			if (cancellable != null)
+				cancellable.set_error_if_cancelled ();
+
+			return yield call.stub.call (api, call.args, cancellable);
+		}
+
+		private class CallPlan {
+			public MethodStub stub;
+			public Coercion[] coercions;
+
+			public CallPlan (MethodStub stub) {
+				this.stub = stub;
+
+				var tuple_type = new VariantType (stub.signature);
+				var arg_count = (int) tuple_type.n_items ();
+				coercions = new Coercion[arg_count];
+				unowned VariantType item_type = tuple_type.first ();
+				for (var i = 0; i != arg_count; i++) {
+					coercions[i] = new Coercion (item_type.copy ());
+					item_type = item_type.next ();
+				}
 			}
 
-			return builder.end ();
+			public Variant[] coerce_argument_list (Variant args) throws IOError {
+				var actual_arg_count = (int) args.n_children ();
+				if (actual_arg_count != coercions.length)
+					throw new IOError.INVALID_ARGUMENT ("argument count mismatch");
+
+				var coerced_args = new Variant[actual_arg_count];
+				for (var i = 0; i != actual_arg_count; i++) {
+					var coerced_arg = coercions[i].apply (args.get_child_value (i));
+					if (coerced_arg == null)
+						throw new IOError.INVALID_ARGUMENT ("argument type mismatch");
+					coerced_args[i] = coerced_arg;
+				}
+
+				return coerced_args;
+			}
 		}
 
-		private bool is_numeric (VariantType type) {
-			VariantType[] numeric_types = {
-				VariantType.INT32,
-				VariantType.UINT32,
-				VariantType.DOUBLE,
-				VariantType.INT64,
-				VariantType.UINT64,
-				VariantType.INT16,
-				VariantType.UINT16,
-				VariantType.BYTE
-			};
+		/* Accepts the expected type as is, or any number that fits the expected numeric type */
+		private class Coercion {
+			private VariantType expected_type;
+			private Variant.Class expected_class;
+			private bool numeric = true;
+			private double min;
+			/* Exclusive, int64 and uint64 maxima round up to their power of two as doubles */
+			private double limit;
+
+			public Coercion (VariantType expected_type) {
+				this.expected_type = expected_type;
+				expected_class = (Variant.Class) expected_type.peek_string ()[0];
 
-			foreach (var numeric_type in numeric_types) {
-				if (type.equal (numeric_type))
-					return true;
+				switch (expected_class) {
+					case Variant.Class.BYTE:
+						min = uint8.MIN;
+						limit = uint8.MAX + 1.0;
+						break;
+					case Variant.Class.INT16:
+						min = int16.MIN;
+						limit = int16.MAX + 1.0;
+						break;
+					case Variant.Class.UINT16:
+						min = uint16.MIN;
+						limit = uint16.MAX + 1.0;
+						break;
+					case Variant.Class.INT32:
+						min = int32.MIN;
+						limit = int32.MAX + 1.0;
+						break;
+					case Variant.Class.UINT32:
+						min = uint32.MIN;
+						limit = uint32.MAX + 1.0;
+						break;
+					case Variant.Class.INT64:
+						min = int64.MIN;
+						limit = int64.MAX + 1.0;
+						break;
+					case Variant.Class.UINT64:
+						min = uint64.MIN;
+						limit = uint64.MAX + 1.0;
+						break;
+					case Variant.Class.DOUBLE:
+						min = -double.INFINITY;
+						limit = double.INFINITY;
+						break;
+					default:
+						numeric = false;
+						break;
+				}
+			}
+
+			public Variant? apply (Variant arg) {
+				if (arg.is_of_type (expected_type))
+					return arg;
+
+				double val;
+				if (!numeric || !get_number (arg, out val) || !(val >= min && val < limit))
+					return null;
+
+				switch (expected_class) {
+					case Variant.Class.BYTE:
+						return new Variant.byte ((uchar) val);
+					case Variant.Class.INT16:
+						return new Variant.int16 ((int16) val);
+					case Variant.Class.UINT16:
+						return new Variant.uint16 ((uint16) val);
+					case Variant.Class.INT32:
+						return new Variant.int32 ((int32) val);
+					case Variant.Class.UINT32:
+						return new Variant.uint32 ((uint32) val);
+					case Variant.Class.INT64:
+						return new Variant.int64 ((int64) val);
+					case Variant.Class.UINT64:
+						return new Variant.uint64 ((uint64) val);
+					default:
+						return new Variant.double (val);
+				}
 			}
 
-			return false;
+			private static bool get_number (Variant arg, out double val) {
+				switch (arg.classify ()) {
+					case Variant.Class.INT32:
+						val = arg.get_int32 ();
+						return true;
+					case Variant.Class.DOUBLE:
+						val = arg.get_double ();
+						return true;
+					case Variant.Class.UINT32:
+						val = arg.get_uint32 ();
+						return true;
+					case Variant.Class.INT64:
+						val = arg.get_int64 ();
+						return true;
+					case Variant.Class.UINT64:
+						val = arg.get_uint64 ();
+						return true;
+					case Variant.Class.INT16:
+						val = arg.get_int16 ();
+						return true;
+					case Variant.Class.UINT16:
+						val = arg.get_uint16 ();
+						return true;
+					case Variant.Class.BYTE:
+						val = arg.get_byte ();
+						return true;
+					default:
+						val = 0;
+						return false;
+				}
+			}
 		}
 	}
 }
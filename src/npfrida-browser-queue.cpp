@@ -0,0 +1,88 @@
+#include "npfrida-browser-queue.h"
+
+#include "npfrida-mpsc-queue.h"
+
+typedef struct _NPFridaBrowserTask NPFridaBrowserTask;
+
+struct _NPFridaBrowserQueue
+{
+  volatile gint ref_count;
+  NPP npp;
+  NPFridaMpscQueue tasks;
+};
+
+struct _NPFridaBrowserTask
+{
+  NPFridaMpscNode node;
+  NPFridaBrowserFunc func;
+  gpointer data;
+};
+
+static void npfrida_browser_queue_drain (void * data);
+
+NPFridaBrowserQueue *
+npfrida_browser_queue_new (NPP npp)
+{
+  NPFridaBrowserQueue * queue;
+
+  queue = g_slice_new (NPFridaBrowserQueue);
+  queue->ref_count = 1;
+  queue->npp = npp;
+  queue->tasks.head = NULL;
+
+  return queue;
+}
+
+NPFridaBrowserQueue *
+npfrida_browser_queue_ref (NPFridaBrowserQueue * self)
+{
+  g_atomic_int_inc (&self->ref_count);
+  return self;
+}
+
+void
+npfrida_browser_queue_unref (NPFridaBrowserQueue * self)
+{
+  if (g_atomic_int_dec_and_test (&self->ref_count))
+  {
+    g_assert (npfrida_mpsc_queue_is_empty (&self->tasks));
+    g_slice_free (NPFridaBrowserQueue, self);
+  }
+}
+
+void
+npfrida_browser_queue_push (NPFridaBrowserQueue * self, NPFridaBrowserFunc func, gpointer data)
+{
+  NPFridaBrowserTask * task;
+
+  task = g_slice_new (NPFridaBrowserTask);
+  task->func = func;
+  task->data = data;
+
+  /* Only the push that makes the queue non-empty needs to wake up the browser */
+  if (npfrida_mpsc_queue_push (&self->tasks, &task->node))
+  {
+    npfrida_browser_queue_ref (self);
+    npfrida_nsfuncs->pluginthreadasynccall (self->npp, npfrida_browser_queue_drain, self);
+  }
+}
+
+static void
+npfrida_browser_queue_drain (void * data)
+{
+  NPFridaBrowserQueue * self = static_cast<NPFridaBrowserQueue *> (data);
+  NPFridaMpscNode * node;
+
+  node = npfrida_mpsc_queue_pop_all (&self->tasks);
+  while (node != NULL)
+  {
+    NPFridaBrowserTask * task = reinterpret_cast<NPFridaBrowserTask *> (node);
+
+    node = node->next;
+
+    task->func (task->data);
+    g_slice_free (NPFridaBrowserTask, task);
+  }
+
+  npfrida_browser_queue_unref (self);
+}
@@ -0,0 +1,18 @@
+#ifndef __NPFRIDA_BROWSER_QUEUE_H__
+#define __NPFRIDA_BROWSER_QUEUE_H__
+
+#include "npfrida-plugin.h"
+
+G_BEGIN_DECLS
+
+typedef void (* NPFridaBrowserFunc) (gpointer data);
+
+G_GNUC_INTERNAL NPFridaBrowserQueue * npfrida_browser_queue_new (NPP npp);
+G_GNUC_INTERNAL NPFridaBrowserQueue * npfrida_browser_queue_ref (NPFridaBrowserQueue * self);
+G_GNUC_INTERNAL void npfrida_browser_queue_unref (NPFridaBrowserQueue * self);
+
+G_GNUC_INTERNAL void npfrida_browser_queue_push (NPFridaBrowserQueue * self, NPFridaBrowserFunc func, gpointer data);
+
+G_END_DECLS
+
+#endif
@@ -1,5 +1,7 @@
 #include "npfrida-byte-array.h"
 
+#include "npfrida-record.h"
+
 #include <string.h>
 
 typedef struct _NPFridaByteArray NPFridaByteArray;
@@ -31,6 +33,8 @@ npfrida_variant_deallocate (NPObject * npobj)
 {
   NPFridaByteArray * self = reinterpret_cast<NPFridaByteArray *> (npobj);
 
+  npfrida_record_forget (npobj);
+
   g_free (self->data);
 
   g_slice_free (NPFridaByteArray, self);
@@ -0,0 +1,443 @@
+#include "npfrida-json-object.h"
+
+#include "npfrida-record.h"
+
+#include <string.h>
+
+typedef struct _NPFridaJsonObject NPFridaJsonObject;
+
+struct _NPFridaJsonObject
+{
+  NPObject np_object;
+  NPP npp;
+  JsonParser * document;
+  JsonNode * node;
+  GHashTable * children;
+};
+
+static NPObject * npfrida_json_object_new (NPP npp, JsonParser * document, JsonNode * node);
+static void npfrida_json_node_to_npvariant (NPFridaJsonObject * parent, NPP npp, JsonParser * document, JsonNode * node,
+    NPVariant * result);
+static JsonNode * npfrida_json_object_lookup (NPFridaJsonObject * self, NPIdentifier name, gboolean * is_length);
+static void npfrida_json_append_variant (GString * json, GVariant * value);
+static void npfrida_json_append_string (GString * json, const gchar * str);
+static void npfrida_json_append_base64 (GString * json, const guchar * data, gsize size);
+
+static NPObject *
+npfrida_json_object_allocate (NPP npp, NPClass * klass)
+{
+  NPFridaJsonObject * obj;
+
+  (void) klass;
+
+  obj = g_slice_new (NPFridaJsonObject);
+  obj->npp = npp;
+  obj->document = NULL;
+  obj->node = NULL;
+  obj->children = NULL;
+
+  return &obj->np_object;
+}
+
+static void
+npfrida_json_object_deallocate (NPObject * npobj)
+{
+  NPFridaJsonObject * self = reinterpret_cast<NPFridaJsonObject *> (npobj);
+
+  npfrida_record_forget (npobj);
+
+  if (self->children != NULL)
+    g_hash_table_unref (self->children);
+  if (self->document != NULL)
+    g_object_unref (self->document);
+
+  g_slice_free (NPFridaJsonObject, self);
+}
+
+static void
+npfrida_json_object_invalidate (NPObject * npobj)
+{
+  (void) npobj;
+}
+
+static bool
+npfrida_json_object_has_method (NPObject * npobj, NPIdentifier name)
+{
+  (void) npobj;
+  (void) name;
+
+  return false;
+}
+
+static bool
+npfrida_json_object_invoke (NPObject * npobj, NPIdentifier name, const NPVariant * args, uint32_t arg_count, NPVariant * result)
+{
+  (void) name;
+  (void) args;
+  (void) arg_count;
+  (void) result;
+
+  npfrida_nsfuncs->setexception (npobj, "no such method");
+  return true;
+}
+
+static bool
+npfrida_json_object_invoke_default (NPObject * npobj, const NPVariant * args, uint32_t arg_count, NPVariant * result)
+{
+  (void) args;
+  (void) arg_count;
+  (void) result;
+
+  npfrida_nsfuncs->setexception (npobj, "invalid operation");
+  return true;
+}
+
+static bool
+npfrida_json_object_has_property (NPObject * npobj, NPIdentifier name)
+{
+  NPFridaJsonObject * self = reinterpret_cast<NPFridaJsonObject *> (npobj);
+  gboolean is_length;
+
+  return npfrida_json_object_lookup (self, name, &is_length) != NULL || is_length;
+}
+
+static bool
+npfrida_json_object_get_property (NPObject * npobj, NPIdentifier name, NPVariant * result)
+{
+  NPFridaJsonObject * self = reinterpret_cast<NPFridaJsonObject *> (npobj);
+  JsonNode * member;
+  gboolean is_length;
+
+  member = npfrida_json_object_lookup (self, name, &is_length);
+  if (member != NULL)
+    npfrida_json_node_to_npvariant (self, self->npp, self->document, member, result);
+  else if (is_length)
+    INT32_TO_NPVARIANT (json_array_get_length (json_node_get_array (self->node)), *result);
+  else
+    VOID_TO_NPVARIANT (*result);
+
+  return true;
+}
+
+static bool
+npfrida_json_object_enumerate (NPObject * npobj, NPIdentifier ** value, uint32_t * count)
+{
+  NPFridaJsonObject * self = reinterpret_cast<NPFridaJsonObject *> (npobj);
+  NPIdentifier * identifiers;
+  guint i;
+
+  if (JSON_NODE_HOLDS_ARRAY (self->node))
+  {
+    guint length = json_array_get_length (json_node_get_array (self->node));
+
+    identifiers = static_cast<NPIdentifier *> (npfrida_nsfuncs->memalloc (MAX (length, 1) * sizeof (NPIdentifier)));
+    for (i = 0; i != length; i++)
+      identifiers[i] = npfrida_nsfuncs->getintidentifier (i);
+    *count = length;
+  }
+  else
+  {
+    GList * members, * cur;
+
+    members = json_object_get_members (json_node_get_object (self->node));
+    identifiers = static_cast<NPIdentifier *> (npfrida_nsfuncs->memalloc (MAX (g_list_length (members), 1) * sizeof (NPIdentifier)));
+    for (cur = members, i = 0; cur != NULL; cur = cur->next, i++)
+      identifiers[i] = npfrida_nsfuncs->getstringidentifier (static_cast<const gchar *> (cur->data));
+    *count = i;
+    g_list_free (members);
+  }
+
+  *value = identifiers;
+  return true;
+}
+
+static NPClass npfrida_json_object_class =
+{
+  NP_CLASS_STRUCT_VERSION,
+  npfrida_json_object_allocate,
+  npfrida_json_object_deallocate,
+  npfrida_json_object_invalidate,
+  npfrida_json_object_has_method,
+  npfrida_json_object_invoke,
+  npfrida_json_object_invoke_default,
+  npfrida_json_object_has_property,
+  npfrida_json_object_get_property,
+  NULL,
+  NULL,
+  npfrida_json_object_enumerate,
+  NULL
+};
+
+JsonParser *
+npfrida_json_document_parse (const gchar * text)
+{
+  JsonParser * document;
+
+  document = json_parser_new ();
+  if (!json_parser_load_from_data (document, text, -1, NULL) || json_parser_get_root (document) == NULL)
+  {
+    g_object_unref (document);
+    return NULL;
+  }
+
+  return document;
+}
+
+void
+npfrida_json_document_to_npvariant (JsonParser * document, NPP npp, NPVariant * result)
+{
+  npfrida_json_node_to_npvariant (NULL, npp, document, json_parser_get_root (document), result);
+}
+
+/* Written straight to a string, there is no intermediate JsonNode tree to build and free */
+gchar *
+npfrida_json_from_variant (GVariant * value)
+{
+  GString * json;
+
+  json = g_string_sized_new (g_variant_get_size (value) * 2);
+  npfrida_json_append_variant (json, value);
+
+  return g_string_free (json, FALSE);
+}
+
+static NPObject *
+npfrida_json_object_new (NPP npp, JsonParser * document, JsonNode * node)
+{
+  NPFridaJsonObject * obj;
+
+  obj = reinterpret_cast<NPFridaJsonObject *> (npfrida_nsfuncs->createobject (npp, &npfrida_json_object_class));
+  obj->document = static_cast<JsonParser *> (g_object_ref (document));
+  obj->node = node;
+
+  return &obj->np_object;
+}
+
+static void
+npfrida_json_node_to_npvariant (NPFridaJsonObject * parent, NPP npp, JsonParser * document, JsonNode * node, NPVariant * result)
+{
+  switch (JSON_NODE_TYPE (node))
+  {
+    case JSON_NODE_OBJECT:
+    case JSON_NODE_ARRAY:
+    {
+      NPObject * obj = NULL;
+
+      /* Children are created on first access and kept so that repeated reads yield the same object */
+      if (parent != NULL)
+      {
+        if (parent->children == NULL)
+          parent->children = g_hash_table_new_full (NULL, NULL, NULL, npfrida_npobject_release);
+        else
+          obj = static_cast<NPObject *> (g_hash_table_lookup (parent->children, node));
+      }
+
+      if (obj == NULL)
+      {
+        obj = npfrida_json_object_new (npp, document, node);
+        if (parent != NULL)
+          g_hash_table_insert (parent->children, node, obj);
+      }
+
+      if (parent != NULL)
+        npfrida_nsfuncs->retainobject (obj);
+
+      OBJECT_TO_NPVARIANT (obj, *result);
+      break;
+    }
+    case JSON_NODE_VALUE:
+      switch (json_node_get_value_type (node))
+      {
+        case G_TYPE_INT64:
+        {
+          gint64 value = json_node_get_int (node);
+          if (value >= G_MININT32 && value <= G_MAXINT32)
+            INT32_TO_NPVARIANT (static_cast<int32_t> (value), *result);
+          else
+            DOUBLE_TO_NPVARIANT (static_cast<double> (value), *result);
+          break;
+        }
+        case G_TYPE_DOUBLE:
+          DOUBLE_TO_NPVARIANT (json_node_get_double (node), *result);
+          break;
+        case G_TYPE_BOOLEAN:
+          BOOLEAN_TO_NPVARIANT (json_node_get_boolean (node), *result);
+          break;
+        case G_TYPE_STRING:
+          npfrida_init_npvariant_with_string (result, json_node_get_string (node));
+          break;
+        default:
+          VOID_TO_NPVARIANT (*result);
+          break;
+      }
+      break;
+    case JSON_NODE_NULL:
+      NULL_TO_NPVARIANT (*result);
+      break;
+  }
+}
+
+static JsonNode *
+npfrida_json_object_lookup (NPFridaJsonObject * self, NPIdentifier name, gboolean * is_length)
+{
+  *is_length = FALSE;
+
+  if (JSON_NODE_HOLDS_ARRAY (self->node))
+  {
+    JsonArray * array = json_node_get_array (self->node);
+
+    if (npfrida_nsfuncs->identifierisstring (name))
+    {
+      *is_length = strcmp (static_cast<NPString *> (name)->UTF8Characters, "length") == 0;
+    }
+    else
+    {
+      int32_t index = npfrida_nsfuncs->intfromidentifier (name);
+      if (index >= 0 && static_cast<guint> (index) < json_array_get_length (array))
+        return json_array_get_element (array, index);
+    }
+  }
+  else if (npfrida_nsfuncs->identifierisstring (name))
+  {
+    return json_object_get_member (json_node_get_object (self->node), static_cast<NPString *> (name)->UTF8Characters);
+  }
+
+  return NULL;
+}
+
+static void
+npfrida_json_append_variant (GString * json, GVariant * value)
+{
+  switch (g_variant_classify (value))
+  {
+    case G_VARIANT_CLASS_BOOLEAN:
+      g_string_append (json, g_variant_get_boolean (value) ? "true" : "false");
+      break;
+    case G_VARIANT_CLASS_INT32:
+      g_string_append_printf (json, "%d", g_variant_get_int32 (value));
+      break;
+    case G_VARIANT_CLASS_UINT32:
+      g_string_append_printf (json, "%u", g_variant_get_uint32 (value));
+      break;
+    case G_VARIANT_CLASS_INT64:
+      g_string_append_printf (json, "%" G_GINT64_FORMAT, g_variant_get_int64 (value));
+      break;
+    case G_VARIANT_CLASS_DOUBLE:
+    {
+      gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+      g_string_append (json, g_ascii_dtostr (buf, sizeof (buf), g_variant_get_double (value)));
+      break;
+    }
+    case G_VARIANT_CLASS_STRING:
+      npfrida_json_append_string (json, g_variant_get_string (value, NULL));
+      break;
+    case G_VARIANT_CLASS_VARIANT:
+    {
+      GVariant * inner = g_variant_get_variant (value);
+      npfrida_json_append_variant (json, inner);
+      g_variant_unref (inner);
+      break;
+    }
+    case G_VARIANT_CLASS_ARRAY:
+    {
+      GVariantIter iter;
+      GVariant * child;
+      gboolean first = TRUE;
+
+      if (g_variant_is_of_type (value, G_VARIANT_TYPE_BYTESTRING))
+      {
+        npfrida_json_append_base64 (json, static_cast<const guchar *> (g_variant_get_data (value)), g_variant_get_size (value));
+      }
+      else if (g_variant_is_of_type (value, G_VARIANT_TYPE_VARDICT))
+      {
+        const gchar * key;
+
+        g_string_append_c (json, '{');
+        g_variant_iter_init (&iter, value);
+        while (g_variant_iter_next (&iter, "{&sv}", &key, &child))
+        {
+          if (!first)
+            g_string_append_c (json, ',');
+          first = FALSE;
+          npfrida_json_append_string (json, key);
+          g_string_append_c (json, ':');
+          npfrida_json_append_variant (json, child);
+          g_variant_unref (child);
+        }
+        g_string_append_c (json, '}');
+      }
+      else
+      {
+        g_string_append_c (json, '[');
+        g_variant_iter_init (&iter, value);
+        while ((child = g_variant_iter_next_value (&iter)) != NULL)
+        {
+          if (!first)
+            g_string_append_c (json, ',');
+          first = FALSE;
+          npfrida_json_append_variant (json, child);
+          g_variant_unref (child);
+        }
+        g_string_append_c (json, ']');
+      }
+      break;
+    }
+    default:
+      g_string_append (json, "null");
+      break;
+  }
+}
+
+static void
+npfrida_json_append_string (GString * json, const gchar * str)
+{
+  const gchar * p;
+
+  g_string_append_c (json, '"');
+  for (p = str; *p != '\0'; p++)
+  {
+    guchar c = static_cast<guchar> (*p);
+
+    switch (c)
+    {
+      case '"':
+        g_string_append (json, "\\\"");
+        break;
+      case '\\':
+        g_string_append (json, "\\\\");
+        break;
+      case '\n':
+        g_string_append (json, "\\n");
+        break;
+      case '\r':
+        g_string_append (json, "\\r");
+        break;
+      case '\t':
+        g_string_append (json, "\\t");
+        break;
+      default:
+        if (c < 0x20)
+          g_string_append_printf (json, "\\u%04x", c);
+        else
+          g_string_append_c (json, c);
+        break;
+    }
+  }
+  g_string_append_c (json, '"');
+}
+
+/* Encodes straight into the output, icons are the bulk of an enumeration */
+static void
+npfrida_json_append_base64 (GString * json, const guchar * data, gsize size)
+{
+  gint state = 0, save = 0;
+  gsize offset;
+
+  g_string_append_c (json, '"');
+  offset = json->len;
+  g_string_set_size (json, offset + (size / 3 + 1) * 4 + 4);
+  offset += g_base64_encode_step (data, size, FALSE, json->str + offset, &state, &save);
+  offset += g_base64_encode_close (FALSE, json->str + offset, &state, &save);
+  g_string_truncate (json, offset);
+  g_string_append_c (json, '"');
+}
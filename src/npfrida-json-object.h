@@ -0,0 +1,17 @@
+#ifndef __NPFRIDA_JSON_OBJECT_H__
+#define __NPFRIDA_JSON_OBJECT_H__
+
+#include "npfrida-plugin.h"
+
+#include <json-glib/json-glib.h>
+
+G_BEGIN_DECLS
+
+G_GNUC_INTERNAL JsonParser * npfrida_json_document_parse (const gchar * text);
+G_GNUC_INTERNAL void npfrida_json_document_to_npvariant (JsonParser * document, NPP npp, NPVariant * result);
+
+G_GNUC_INTERNAL gchar * npfrida_json_from_variant (GVariant * value);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,299 @@
+#include "npfrida-list.h"
+
+#include "npfrida-record.h"
+
+#include <string.h>
+
+typedef struct _NPFridaList NPFridaList;
+
+struct _NPFridaList
+{
+  NPObject np_object;
+  NPP npp;
+  GVariant * items;
+  gint length;
+  NPObject ** elements;
+};
+
+static gboolean npfrida_list_lookup_index (NPFridaList * self, NPIdentifier name, gint * index);
+static void npfrida_list_value_to_npvariant (NPFridaList * self, GVariant * value, NPVariant * result);
+static NPObject * npfrida_list_dict_to_npobject (NPFridaList * self, GVariant * dict);
+
+static NPObject *
+npfrida_list_allocate (NPP npp, NPClass * klass)
+{
+  NPFridaList * obj;
+
+  (void) klass;
+
+  obj = g_slice_new (NPFridaList);
+  obj->npp = npp;
+  obj->items = NULL;
+  obj->length = 0;
+  obj->elements = NULL;
+
+  return &obj->np_object;
+}
+
+static void
+npfrida_list_deallocate (NPObject * npobj)
+{
+  NPFridaList * self = reinterpret_cast<NPFridaList *> (npobj);
+  gint i;
+
+  npfrida_record_forget (npobj);
+
+  for (i = 0; i != self->length; i++)
+  {
+    if (self->elements[i] != NULL)
+      npfrida_nsfuncs->releaseobject (self->elements[i]);
+  }
+  g_free (self->elements);
+
+  if (self->items != NULL)
+    g_variant_unref (self->items);
+
+  g_slice_free (NPFridaList, self);
+}
+
+static void
+npfrida_list_invalidate (NPObject * npobj)
+{
+  (void) npobj;
+}
+
+static bool
+npfrida_list_has_method (NPObject * npobj, NPIdentifier name)
+{
+  (void) npobj;
+  (void) name;
+
+  return false;
+}
+
+static bool
+npfrida_list_invoke (NPObject * npobj, NPIdentifier name, const NPVariant * args, uint32_t arg_count, NPVariant * result)
+{
+  (void) name;
+  (void) args;
+  (void) arg_count;
+  (void) result;
+
+  npfrida_nsfuncs->setexception (npobj, "no such method");
+  return true;
+}
+
+static bool
+npfrida_list_invoke_default (NPObject * npobj, const NPVariant * args, uint32_t arg_count, NPVariant * result)
+{
+  (void) args;
+  (void) arg_count;
+  (void) result;
+
+  npfrida_nsfuncs->setexception (npobj, "invalid operation");
+  return true;
+}
+
+static bool
+npfrida_list_has_property (NPObject * npobj, NPIdentifier name)
+{
+  NPFridaList * self = reinterpret_cast<NPFridaList *> (npobj);
+  gint index;
+
+  if (npfrida_nsfuncs->identifierisstring (name))
+    return strcmp (static_cast<NPString *> (name)->UTF8Characters, "length") == 0;
+
+  return npfrida_list_lookup_index (self, name, &index);
+}
+
+static bool
+npfrida_list_get_property (NPObject * npobj, NPIdentifier name, NPVariant * result)
+{
+  NPFridaList * self = reinterpret_cast<NPFridaList *> (npobj);
+  gint index;
+
+  if (npfrida_nsfuncs->identifierisstring (name))
+  {
+    if (strcmp (static_cast<NPString *> (name)->UTF8Characters, "length") == 0)
+    {
+      INT32_TO_NPVARIANT (self->length, *result);
+      return true;
+    }
+  }
+  else if (npfrida_list_lookup_index (self, name, &index))
+  {
+    NPObject * element = self->elements[index];
+
+    /* Elements are converted on first access and kept for identity */
+    if (element == NULL)
+    {
+      GVariant * value;
+
+      value = g_variant_get_child_value (self->items, index);
+      npfrida_list_value_to_npvariant (self, value, result);
+      g_variant_unref (value);
+
+      if (NPVARIANT_IS_OBJECT (*result))
+      {
+        self->elements[index] = NPVARIANT_TO_OBJECT (*result);
+        npfrida_nsfuncs->retainobject (self->elements[index]);
+      }
+    }
+    else
+    {
+      npfrida_nsfuncs->retainobject (element);
+      OBJECT_TO_NPVARIANT (element, *result);
+    }
+
+    return true;
+  }
+
+  VOID_TO_NPVARIANT (*result);
+  return true;
+}
+
+static bool
+npfrida_list_enumerate (NPObject * npobj, NPIdentifier ** value, uint32_t * count)
+{
+  NPFridaList * self = reinterpret_cast<NPFridaList *> (npobj);
+  NPIdentifier * identifiers;
+  gint i;
+
+  identifiers = static_cast<NPIdentifier *> (npfrida_nsfuncs->memalloc (MAX (self->length, 1) * sizeof (NPIdentifier)));
+  for (i = 0; i != self->length; i++)
+    identifiers[i] = npfrida_nsfuncs->getintidentifier (i);
+
+  *value = identifiers;
+  *count = self->length;
+  return true;
+}
+
+static NPClass npfrida_list_class =
+{
+  NP_CLASS_STRUCT_VERSION,
+  npfrida_list_allocate,
+  npfrida_list_deallocate,
+  npfrida_list_invalidate,
+  npfrida_list_has_method,
+  npfrida_list_invoke,
+  npfrida_list_invoke_default,
+  npfrida_list_has_property,
+  npfrida_list_get_property,
+  NULL,
+  NULL,
+  npfrida_list_enumerate,
+  NULL
+};
+
+NPObject *
+npfrida_list_new (NPP npp, GVariant * items)
+{
+  NPFridaList * obj;
+
+  obj = reinterpret_cast<NPFridaList *> (npfrida_nsfuncs->createobject (npp, &npfrida_list_class));
+  obj->items = g_variant_ref (items);
+  obj->length = g_variant_n_children (items);
+  obj->elements = g_new0 (NPObject *, obj->length);
+
+  return &obj->np_object;
+}
+
+static gboolean
+npfrida_list_lookup_index (NPFridaList * self, NPIdentifier name, gint * index)
+{
+  *index = npfrida_nsfuncs->intfromidentifier (name);
+
+  return *index >= 0 && *index < self->length;
+}
+
+static void
+npfrida_list_value_to_npvariant (NPFridaList * self, GVariant * value, NPVariant * result)
+{
+  switch (g_variant_classify (value))
+  {
+    case G_VARIANT_CLASS_BOOLEAN:
+      BOOLEAN_TO_NPVARIANT (g_variant_get_boolean (value), *result);
+      break;
+    case G_VARIANT_CLASS_INT32:
+      INT32_TO_NPVARIANT (g_variant_get_int32 (value), *result);
+      break;
+    case G_VARIANT_CLASS_UINT32:
+    {
+      guint32 v = g_variant_get_uint32 (value);
+      if (v <= G_MAXINT32)
+        INT32_TO_NPVARIANT (static_cast<int32_t> (v), *result);
+      else
+        DOUBLE_TO_NPVARIANT (static_cast<double> (v), *result);
+      break;
+    }
+    case G_VARIANT_CLASS_DOUBLE:
+      DOUBLE_TO_NPVARIANT (g_variant_get_double (value), *result);
+      break;
+    case G_VARIANT_CLASS_STRING:
+      npfrida_init_npvariant_with_string (result, g_variant_get_string (value, NULL));
+      break;
+    case G_VARIANT_CLASS_VARIANT:
+    {
+      GVariant * inner = g_variant_get_variant (value);
+      npfrida_list_value_to_npvariant (self, inner, result);
+      g_variant_unref (inner);
+      break;
+    }
+    case G_VARIANT_CLASS_ARRAY:
+      if (g_variant_is_of_type (value, G_VARIANT_TYPE_BYTESTRING))
+      {
+        /* Same representation as the JSON path, so pages see no difference */
+        gchar * str = g_base64_encode (static_cast<const guchar *> (g_variant_get_data (value)), g_variant_get_size (value));
+        npfrida_init_npvariant_with_string (result, str);
+        g_free (str);
+      }
+      else if (g_variant_is_of_type (value, G_VARIANT_TYPE_VARDICT))
+      {
+        NPObject * obj = npfrida_list_dict_to_npobject (self, value);
+        if (obj != NULL)
+          OBJECT_TO_NPVARIANT (obj, *result);
+        else
+          NULL_TO_NPVARIANT (*result);
+      }
+      else
+      {
+        OBJECT_TO_NPVARIANT (npfrida_list_new (self->npp, value), *result);
+      }
+      break;
+    default:
+      VOID_TO_NPVARIANT (*result);
+      break;
+  }
+}
+
+static NPObject *
+npfrida_list_dict_to_npobject (NPFridaList * self, GVariant * dict)
+{
+  NPNetscapeFuncs * browser = npfrida_nsfuncs;
+  NPObject * window = NULL;
+  NPVariant object;
+  GVariantIter iter;
+  const gchar * key;
+  GVariant * child;
+
+  VOID_TO_NPVARIANT (object);
+  if (browser->getvalue (self->npp, NPNVWindowNPObject, &window) != NPERR_NO_ERROR)
+    return NULL;
+  browser->invoke (self->npp, window, browser->getstringidentifier ("Object"), NULL, 0, &object);
+  browser->releaseobject (window);
+  if (!NPVARIANT_IS_OBJECT (object))
+    return NULL;
+
+  g_variant_iter_init (&iter, dict);
+  while (g_variant_iter_next (&iter, "{&sv}", &key, &child))
+  {
+    NPVariant member;
+
+    npfrida_list_value_to_npvariant (self, child, &member);
+    browser->setproperty (self->npp, NPVARIANT_TO_OBJECT (object), browser->getstringidentifier (key), &member);
+    browser->releasevariantvalue (&member);
+    g_variant_unref (child);
+  }
+
+  return NPVARIANT_TO_OBJECT (object);
+}
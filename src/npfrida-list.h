@@ -0,0 +1,12 @@
+#ifndef __NPFRIDA_LIST_H__
+#define __NPFRIDA_LIST_H__
+
+#include "npfrida-plugin.h"
+
+G_BEGIN_DECLS
+
+G_GNUC_INTERNAL NPObject * npfrida_list_new (NPP npp, GVariant * items);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,337 @@
+#include "npfrida-log.h"
+
+#include "npfrida-browser-queue.h"
+#include "npfrida-mpsc-queue.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NPFRIDA_LOG_CAPACITY 4096
+
+typedef struct _NPFridaLogEntry NPFridaLogEntry;
+
+struct _NPFridaLogEntry
+{
+  NPFridaMpscNode node;
+  gint64 time;
+  GLogLevelFlags level;
+  const gchar * domain;
+  gchar message[1];
+};
+
+static void npfrida_log_handle (const gchar * log_domain, GLogLevelFlags log_level, const gchar * message, gpointer user_data);
+static gboolean npfrida_log_domain_enabled (const gchar * log_domain);
+static void npfrida_log_schedule_flush (void);
+static void npfrida_log_flush (gpointer data);
+static void npfrida_log_drain (NPP instance);
+static void npfrida_log_write_to_console (NPP instance, const gchar * text);
+static void npfrida_log_write_to_file (NPFridaLogEntry * entry);
+static GLogLevelFlags npfrida_log_parse_levels (const gchar * name);
+static const gchar * npfrida_log_level_to_string (GLogLevelFlags level);
+
+static NPFridaMpscQueue npfrida_log_entries = NPFRIDA_MPSC_QUEUE_INIT;
+static volatile gint npfrida_log_pending = 0;
+static volatile guint npfrida_log_dropped = 0;
+
+/* Fixed at init, read without locking from every logging thread */
+static GLogLevelFlags npfrida_log_levels = G_LOG_LEVEL_MASK;
+static gchar ** npfrida_log_domains = NULL;
+/* Only written from the browser thread */
+static FILE * npfrida_log_file = NULL;
+
+G_LOCK_DEFINE_STATIC (npfrida_log);
+static NPP npfrida_log_instance = NULL;
+static NPFridaBrowserQueue * npfrida_log_queue = NULL;
+
+void
+npfrida_log_init (void)
+{
+  const gchar * domains, * path;
+
+  npfrida_log_levels = npfrida_log_parse_levels (g_getenv ("NPFRIDA_LOG_LEVEL"));
+
+  domains = g_getenv ("NPFRIDA_LOG_DOMAINS");
+  if (domains != NULL && domains[0] != '\0')
+    npfrida_log_domains = g_strsplit (domains, ",", -1);
+
+  path = g_getenv ("NPFRIDA_LOG_FILE");
+  if (path != NULL && path[0] != '\0')
+  {
+    npfrida_log_file = g_fopen (path, "ab");
+    if (npfrida_log_file == NULL)
+      g_warning ("Failed to open %s for logging", path);
+  }
+
+  g_log_set_default_handler (npfrida_log_handle, NULL);
+}
+
+void
+npfrida_log_deinit (void)
+{
+  g_log_set_default_handler (g_log_default_handler, NULL);
+
+  npfrida_log_set_target (NULL);
+  npfrida_log_drain (NULL);
+
+  if (npfrida_log_file != NULL)
+  {
+    fclose (npfrida_log_file);
+    npfrida_log_file = NULL;
+  }
+
+  g_strfreev (npfrida_log_domains);
+  npfrida_log_domains = NULL;
+}
+
+void
+npfrida_log_set_target (NPP instance)
+{
+  NPFridaBrowserQueue * previous;
+
+  G_LOCK (npfrida_log);
+  previous = npfrida_log_queue;
+  npfrida_log_instance = instance;
+  npfrida_log_queue = (instance != NULL) ? npfrida_browser_queue_ref (npfrida_plugin_get_browser_queue (instance)) : NULL;
+  /* A flush scheduled on the previous instance may never run */
+  if (!npfrida_mpsc_queue_is_empty (&npfrida_log_entries))
+    npfrida_log_schedule_flush ();
+  G_UNLOCK (npfrida_log);
+
+  if (previous != NULL)
+    npfrida_browser_queue_unref (previous);
+}
+
+static void
+npfrida_log_handle (const gchar * log_domain, GLogLevelFlags log_level, const gchar * message, gpointer user_data)
+{
+  NPFridaLogEntry * entry;
+  gsize length, domain_length;
+
+  (void) user_data;
+
+  if ((log_level & npfrida_log_levels) == 0 || !npfrida_log_domain_enabled (log_domain))
+    return;
+
+  /* The process is about to abort, or nobody would flush the queue */
+  if ((log_level & G_LOG_FLAG_FATAL) != 0 || g_atomic_pointer_get (&npfrida_log_queue) == NULL)
+  {
+    g_log_default_handler (log_domain, log_level, message, NULL);
+    return;
+  }
+
+  if (g_atomic_int_add (&npfrida_log_pending, 1) >= NPFRIDA_LOG_CAPACITY)
+  {
+    g_atomic_int_add (&npfrida_log_pending, -1);
+    g_atomic_int_inc (&npfrida_log_dropped);
+    return;
+  }
+
+  /* The domain is copied behind the message, interning it would take GLib's global quark lock */
+  length = strlen (message);
+  domain_length = (log_domain != NULL) ? strlen (log_domain) + 1 : 0;
+  entry = static_cast<NPFridaLogEntry *> (g_malloc (G_STRUCT_OFFSET (NPFridaLogEntry, message) + length + 1 + domain_length));
+  entry->time = g_get_real_time ();
+  entry->level = static_cast<GLogLevelFlags> (log_level & G_LOG_LEVEL_MASK);
+  memcpy (entry->message, message, length + 1);
+  if (log_domain != NULL)
+  {
+    entry->domain = entry->message + length + 1;
+    memcpy (entry->message + length + 1, log_domain, domain_length);
+  }
+  else
+  {
+    entry->domain = NULL;
+  }
+
+  /* Only the push that makes the queue non-empty needs to schedule a flush */
+  if (npfrida_mpsc_queue_push (&npfrida_log_entries, &entry->node))
+  {
+    G_LOCK (npfrida_log);
+    npfrida_log_schedule_flush ();
+    G_UNLOCK (npfrida_log);
+  }
+}
+
+static gboolean
+npfrida_log_domain_enabled (const gchar * log_domain)
+{
+  gchar ** domain;
+
+  if (npfrida_log_domains == NULL)
+    return TRUE;
+
+  if (log_domain == NULL)
+    log_domain = "default";
+
+  for (domain = npfrida_log_domains; *domain != NULL; domain++)
+  {
+    if (strcmp (*domain, log_domain) == 0)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/* Called with the lock held */
+static void
+npfrida_log_schedule_flush (void)
+{
+  if (npfrida_log_queue != NULL)
+    npfrida_browser_queue_push (npfrida_log_queue, npfrida_log_flush, NULL);
+}
+
+static void
+npfrida_log_flush (gpointer data)
+{
+  NPP instance;
+
+  (void) data;
+
+  G_LOCK (npfrida_log);
+  instance = npfrida_log_instance;
+  G_UNLOCK (npfrida_log);
+
+  npfrida_log_drain (instance);
+}
+
+static void
+npfrida_log_drain (NPP instance)
+{
+  NPFridaMpscNode * node;
+  GString * batch;
+  gint count = 0;
+  guint dropped;
+
+  node = npfrida_mpsc_queue_pop_all (&npfrida_log_entries);
+  dropped = g_atomic_int_and (&npfrida_log_dropped, 0);
+  if (node == NULL && dropped == 0)
+    return;
+
+  batch = g_string_new (NULL);
+  while (node != NULL)
+  {
+    NPFridaLogEntry * entry = reinterpret_cast<NPFridaLogEntry *> (node);
+
+    node = node->next;
+
+    if (npfrida_log_file != NULL)
+      npfrida_log_write_to_file (entry);
+    if (batch->len != 0)
+      g_string_append_c (batch, '\n');
+    g_string_append (batch, entry->message);
+
+    g_free (entry);
+    count++;
+  }
+  g_atomic_int_add (&npfrida_log_pending, -count);
+
+  if (dropped != 0)
+  {
+    if (batch->len != 0)
+      g_string_append_c (batch, '\n');
+    g_string_append_printf (batch, "(%u log messages dropped)", dropped);
+  }
+
+  if (npfrida_log_file != NULL)
+    fflush (npfrida_log_file);
+
+  if (instance != NULL)
+    npfrida_log_write_to_console (instance, batch->str);
+  else
+    g_printerr ("%s\n", batch->str);
+
+  g_string_free (batch, TRUE);
+}
+
+static void
+npfrida_log_write_to_console (NPP instance, const gchar * text)
+{
+  NPNetscapeFuncs * browser = npfrida_nsfuncs;
+  NPObject * window = NULL, * console = NULL;
+  NPVariant variant, result;
+  NPError error;
+
+  error = browser->getvalue (instance, NPNVWindowNPObject, &window);
+  if (error != NPERR_NO_ERROR)
+    goto beach;
+
+  VOID_TO_NPVARIANT (variant);
+  if (!browser->getproperty (instance, window, browser->getstringidentifier ("console"), &variant))
+    goto beach;
+  console = NPVARIANT_TO_OBJECT (variant);
+
+  STRINGZ_TO_NPVARIANT (text, variant);
+  VOID_TO_NPVARIANT (result);
+  if (!browser->invoke (instance, console, browser->getstringidentifier ("log"), &variant, 1, &result))
+    goto beach;
+  browser->releasevariantvalue (&result);
+
+beach:
+  if (console != NULL)
+    browser->releaseobject (console);
+  if (window != NULL)
+    browser->releaseobject (window);
+}
+
+static void
+npfrida_log_write_to_file (NPFridaLogEntry * entry)
+{
+  fprintf (npfrida_log_file, "%" G_GINT64_FORMAT ".%06d %s %s: %s\n",
+      entry->time / G_USEC_PER_SEC, static_cast<gint> (entry->time % G_USEC_PER_SEC),
+      (entry->domain != NULL) ? entry->domain : "default",
+      npfrida_log_level_to_string (entry->level),
+      entry->message);
+}
+
+static GLogLevelFlags
+npfrida_log_parse_levels (const gchar * name)
+{
+  static const struct
+  {
+    const gchar * name;
+    GLogLevelFlags level;
+  } levels[] =
+  {
+    { "error", G_LOG_LEVEL_ERROR },
+    { "critical", G_LOG_LEVEL_CRITICAL },
+    { "warning", G_LOG_LEVEL_WARNING },
+    { "message", G_LOG_LEVEL_MESSAGE },
+    { "info", G_LOG_LEVEL_INFO },
+    { "debug", G_LOG_LEVEL_DEBUG }
+  };
+  guint i;
+
+  if (name == NULL || name[0] == '\0')
+    return G_LOG_LEVEL_MASK;
+
+  /* More severe levels have lower bits, keep everything up to the chosen one */
+  for (i = 0; i != G_N_ELEMENTS (levels); i++)
+  {
+    if (g_ascii_strcasecmp (levels[i].name, name) == 0)
+      return static_cast<GLogLevelFlags> (((levels[i].level << 1) - 1) & G_LOG_LEVEL_MASK);
+  }
+
+  g_warning ("Unknown log level %s, logging everything", name);
+  return G_LOG_LEVEL_MASK;
+}
+
+static const gchar *
+npfrida_log_level_to_string (GLogLevelFlags level)
+{
+  switch (level)
+  {
+    case G_LOG_LEVEL_ERROR:
+      return "ERROR";
+    case G_LOG_LEVEL_CRITICAL:
+      return "CRITICAL";
+    case G_LOG_LEVEL_WARNING:
+      return "WARNING";
+    case G_LOG_LEVEL_MESSAGE:
+      return "Message";
+    case G_LOG_LEVEL_INFO:
+      return "INFO";
+    default:
+      return "DEBUG";
+  }
+}
@@ -0,0 +1,26 @@
+#ifndef __NPFRIDA_LOG_H__
+#define __NPFRIDA_LOG_H__
+
+#include "npfrida-plugin.h"
+
+/*
+ * GLib log sink. Lines are queued from any thread and flushed to the
+ * console of the target instance in batches, one browser hop per batch.
+ *
+ *   NPFRIDA_LOG_LEVEL    most verbose level kept: error, critical, warning,
+ *                        message, info or debug (default)
+ *   NPFRIDA_LOG_DOMAINS  comma-separated domains to keep, "default" matches
+ *                        lines without a domain
+ *   NPFRIDA_LOG_FILE     also append timestamped lines to this file
+ */
+
+G_BEGIN_DECLS
+
+G_GNUC_INTERNAL void npfrida_log_init (void);
+G_GNUC_INTERNAL void npfrida_log_deinit (void);
+
+G_GNUC_INTERNAL void npfrida_log_set_target (NPP instance);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,186 @@
+#if NPFRIDA_MOCK
+namespace NPFrida {
+	/*
+	 * Simulated backend, selected at build time with --enable-mock-backend.
+	 * It is shaped through NPFRIDA_MOCK_* environment variables so that load
+	 * tests do not depend on real devices or processes.
+	 */
+	public class Root : Object, RootApi {
+		private uint device_count = get_setting ("NPFRIDA_MOCK_DEVICES", 1);
+		private uint process_count = get_setting ("NPFRIDA_MOCK_PROCESSES", 100);
+		private uint icon_size = get_setting ("NPFRIDA_MOCK_ICON_SIZE", 16);
+		private uint attach_latency = get_setting ("NPFRIDA_MOCK_ATTACH_LATENCY", 0);
+		private uint message_rate = get_setting ("NPFRIDA_MOCK_MESSAGE_RATE", 0);
+		private uint message_size = get_setting ("NPFRIDA_MOCK_MESSAGE_SIZE", 0);
+
+		private Gee.HashMap<string, Session> sessions = new Gee.HashMap<string, Session> ();
+
+		protected override async void destroy () {
+			foreach (var session in sessions.values)
+				session.stop ();
+			sessions.clear ();
+		}
+
+		public async Variant enumerate_devices (Cancellable? cancellable = null) throws Error {
+			check_cancelled (cancellable);
+			var builder = new VariantBuilder (new VariantType ("aa{sv}"));
+			for (uint i = 0; i != device_count; i++) {
+				builder.open (VariantType.VARDICT);
+				builder.add ("{sv}", "id", new Variant.uint32 (i + 1));
+				builder.add ("{sv}", "name", new Variant.string ("Mock Device %u".printf (i + 1)));
+				add_icon (builder, "icon", icon_size);
+				builder.add ("{sv}", "type", new Variant.string ((i == 0) ? "local" : "remote"));
+				builder.close ();
+			}
+			return builder.end ();
+		}
+
+		public async Variant enumerate_processes (uint device_id, Cancellable? cancellable = null) throws Error {
+			check_device (device_id);
+			check_cancelled (cancellable);
+			var builder = new VariantBuilder (new VariantType ("aa{sv}"));
+			for (uint i = 0; i != process_count; i++) {
+				builder.open (VariantType.VARDICT);
+				builder.add ("{sv}", "pid", new Variant.uint32 (1000 + i));
+				builder.add ("{sv}", "name", new Variant.string ("process-%u".printf (i)));
+				add_icon (builder, "small_icon", icon_size);
+				add_icon (builder, "large_icon", icon_size * 2);
+				builder.close ();
+			}
+			return builder.end ();
+		}
+
+		/* Nothing to warm up, snapshots are generated on demand */
+		public void prewarm () {
+		}
+
+		private static void add_icon (VariantBuilder builder, string member_name, uint size) {
+			if (size == 0)
+				return;
+			var pixels = new uint8[size * size * 4];
+			var image = new VariantBuilder (VariantType.VARDICT);
+			image.add ("{sv}", "width", new Variant.int32 ((int32) size));
+			image.add ("{sv}", "height", new Variant.int32 ((int32) size));
+			image.add ("{sv}", "rowstride", new Variant.int32 ((int32) size * 4));
+			image.add ("{sv}", "pixels", new Variant.from_bytes (VariantType.BYTESTRING, new Bytes (pixels), true));
+			builder.add ("{sv}", member_name, image.end ());
+		}
+
+		/* Any pid is accepted, so benchmarks written for real processes work unchanged */
+		public async void attach_to (uint device_id, uint pid, string source, Cancellable? cancellable = null) throws Error {
+			check_device (device_id);
+			if (attach_latency != 0)
+				yield sleep (attach_latency);
+			check_cancelled (cancellable);
+
+			var key = make_key (device_id, pid);
+			var previous = sessions[key];
+			if (previous != null)
+				previous.stop ();
+
+			var session = new Session (this, device_id, pid, message_rate, message_size);
+			sessions[key] = session;
+			session.start ();
+		}
+
+		public async void post_message (uint device_id, uint pid, string message, Cancellable? cancellable = null) throws Error {
+			check_device (device_id);
+			check_cancelled (cancellable);
+			if (!sessions.has_key (make_key (device_id, pid)))
+				throw new IOError.FAILED ("not attached");
+		}
+
+		public async void detach_from (uint device_id, uint pid, Cancellable? cancellable = null) throws Error {
+			check_device (device_id);
+			check_cancelled (cancellable);
+			Session session;
+			if (!sessions.unset (make_key (device_id, pid), out session))
+				throw new IOError.FAILED ("not attached");
+			session.stop ();
+			detach (device_id, pid);
+		}
+
+		private void check_device (uint device_id) throws IOError {
+			if (device_id == 0 || device_id > device_count)
+				throw new IOError.FAILED ("invalid device id");
+		}
+
+		private static void check_cancelled (Cancellable? cancellable) throws IOError {
+			if (cancellable != null)
+				cancellable.set_error_if_cancelled ();
+		}
+
+		private static string make_key (uint device_id, uint pid) {
+			return "%u:%u".printf (device_id, pid);
+		}
+
+		private static uint get_setting (string name, uint default_value) {
+			var val = Environment.get_variable (name);
+			if (val == null)
+				return default_value;
+			return (uint) uint64.parse (val);
+		}
+
+		private static async void sleep (uint msec) {
+			var source = new TimeoutSource (msec);
+			source.set_callback (() => {
+				sleep.callback ();
+				return false;
+			});
+			source.attach (MainContext.ref_thread_default ());
+			yield;
+		}
+
+		/* Emits messages shaped like a script's send (), paced to a fixed rate */
+		private class Session : GLib.Object {
+			private weak Root parent;
+			private uint device_id;
+			private uint pid;
+			private uint rate;
+			private Bytes? data;
+
+			private Source timer;
+			private int64 start_time;
+			private uint64 sent = 0;
+
+			public Session (Root parent, uint device_id, uint pid, uint rate, uint data_size) {
+				this.parent = parent;
+				this.device_id = device_id;
+				this.pid = pid;
+				this.rate = rate;
+				if (data_size != 0)
+					this.data = new Bytes (new uint8[data_size]);
+			}
+
+			public void start () {
+				if (rate == 0)
+					return;
+				start_time = get_monotonic_time ();
+				timer = new TimeoutSource (1);
+				timer.set_callback (on_tick);
+				timer.attach (MainContext.ref_thread_default ());
+			}
+
+			public void stop () {
+				if (timer == null)
+					return;
+				timer.destroy ();
+				timer = null;
+			}
+
+			private bool on_tick () {
+				var due = (uint64) (rate * ((get_monotonic_time () - start_time) / 1000000.0)) + 1;
+				for (; sent < due; sent++) {
+					var text = "{\"type\":\"send\",\"payload\":{\"seq\":" + sent.to_string () +
+						",\"t\":" + (get_real_time () / 1000).to_string () + "}}";
+					Variant? data_value = null;
+					if (data != null)
+						data_value = new Variant.from_bytes (new VariantType ("ay"), data, true);
+					parent.message (device_id, pid, text, data_value);
+				}
+				return true;
+			}
+		}
+	}
+}
+#endif
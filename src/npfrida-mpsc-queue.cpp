@@ -0,0 +1,45 @@
+#include "npfrida-mpsc-queue.h"
+
+gboolean
+npfrida_mpsc_queue_push (NPFridaMpscQueue * self, NPFridaMpscNode * node)
+{
+  gpointer head;
+
+  do
+  {
+    head = g_atomic_pointer_get (&self->head);
+    node->next = static_cast<NPFridaMpscNode *> (head);
+  }
+  while (!g_atomic_pointer_compare_and_exchange (&self->head, head, node));
+
+  return head == NULL;
+}
+
+NPFridaMpscNode *
+npfrida_mpsc_queue_pop_all (NPFridaMpscQueue * self)
+{
+  gpointer head;
+  NPFridaMpscNode * node, * reversed = NULL;
+
+  do
+    head = g_atomic_pointer_get (&self->head);
+  while (head != NULL && !g_atomic_pointer_compare_and_exchange (&self->head, head, NULL));
+
+  /* The nodes were pushed LIFO, hand them back in submission order */
+  node = static_cast<NPFridaMpscNode *> (head);
+  while (node != NULL)
+  {
+    NPFridaMpscNode * next = node->next;
+    node->next = reversed;
+    reversed = node;
+    node = next;
+  }
+
+  return reversed;
+}
+
+gboolean
+npfrida_mpsc_queue_is_empty (NPFridaMpscQueue * self)
+{
+  return g_atomic_pointer_get (&self->head) == NULL;
+}
@@ -0,0 +1,29 @@
+#ifndef __NPFRIDA_MPSC_QUEUE_H__
+#define __NPFRIDA_MPSC_QUEUE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _NPFridaMpscQueue NPFridaMpscQueue;
+typedef struct _NPFridaMpscNode NPFridaMpscNode;
+
+struct _NPFridaMpscQueue
+{
+  volatile gpointer head;
+};
+
+struct _NPFridaMpscNode
+{
+  NPFridaMpscNode * next;
+};
+
+#define NPFRIDA_MPSC_QUEUE_INIT { NULL }
+
+G_GNUC_INTERNAL gboolean npfrida_mpsc_queue_push (NPFridaMpscQueue * self, NPFridaMpscNode * node);
+G_GNUC_INTERNAL NPFridaMpscNode * npfrida_mpsc_queue_pop_all (NPFridaMpscQueue * self);
+G_GNUC_INTERNAL gboolean npfrida_mpsc_queue_is_empty (NPFridaMpscQueue * self);
+
+G_END_DECLS
+
+#endif
@@ -24,6 +24,10 @@ struct _NPFridaNPObjectClass
 
 G_GNUC_INTERNAL void npfrida_np_object_destroy (NPFridaNPObject * obj);
 
+G_GNUC_INTERNAL GVariant * npfrida_object_argument_list_to_gvariant (NPFridaObject * self, const NPVariant * args, guint arg_count, GError ** err);
+G_GNUC_INTERNAL void npfrida_object_gvariant_to_npvariant (NPFridaObject * self, GVariant * retval, NPVariant * result);
+G_GNUC_INTERNAL gboolean npfrida_object_gvalue_to_npvariant (NPFridaObject * self, const GValue * gvalue, NPVariant * result);
+
 G_END_DECLS
 
 #endif
@@ -1,44 +1,76 @@
 #include "npfrida-object.h"
 
 #include "npfrida.h"
+#include "npfrida-browser-queue.h"
+#include "npfrida-json-object.h"
+#include "npfrida-list.h"
+#include "npfrida-stats.h"
+#include "npfrida-trace.h"
 #include "npfrida-byte-array.h"
 #include "npfrida-object-priv.h"
 #include "npfrida-plugin.h"
 #include "npfrida-promise.h"
+#include "npfrida-record.h"
+#include "npfrida-work-source.h"
+
+#include <json-glib/json-glib.h>
 
 typedef struct _NPFridaObjectPrivate NPFridaObjectPrivate;
 
 typedef struct _NPFridaDestroyContext NPFridaDestroyContext;
 typedef struct _NPFridaInvokeContext NPFridaInvokeContext;
 typedef struct _NPFridaGetPropertyContext NPFridaGetPropertyContext;
+typedef struct _NPFridaListener NPFridaListener;
 typedef struct _NPFridaClosure NPFridaClosure;
 typedef struct _NPFridaClosureInvocation NPFridaClosureInvocation;
 
 struct _NPFridaObjectPrivate
 {
   NPP npp;
+  NPFridaBrowserQueue * browser_queue;
+  NPFridaWorkQueue * work_queue;
   NPFridaDispatcher * dispatcher;
   GCond cond;
   NPObject * json;
+  GHashTable * closures;
+  GHashTable * call_timeouts;
+  guint default_call_timeout;
+  GHashTable * stats;
+  gboolean lazy_json;
 };
 
 struct _NPFridaDestroyContext
 {
+  NPFridaWorkItem work;
   NPFridaObject * self;
   volatile gboolean completed;
 };
 
 struct _NPFridaInvokeContext
 {
-  gchar * function_name;
-  GVariant * arguments;
+  NPFridaWorkItem work;
+  volatile gint ref_count;
+  NPFridaObject * self;
+  const gchar * function_name;
+  NPFridaPreparedCall * call;
+  GCancellable * cancellable;
   NPObject * promise;
+  guint timeout;
+  GSource * timeout_source;
+  gboolean settled;
+  NPFridaMethodStats * stats;
+  gint64 start_time;
+  gint64 submit_time;
+  gint64 begin_time;
+  gint64 ready_time;
   GVariant * retval;
+  JsonParser * document;
   GError * error;
 };
 
 struct _NPFridaGetPropertyContext
 {
+  NPFridaWorkItem work;
   NPFridaObject * self;
 
   const gchar * property_name;
@@ -47,38 +79,68 @@ struct _NPFridaGetPropertyContext
   volatile gboolean completed;
 };
 
+struct _NPFridaListener
+{
+  volatile gint ref_count;
+  NPObject * callback;
+
+  gboolean match_device_id;
+  guint device_id;
+  gboolean match_pid;
+  guint pid;
+  gchar * type;
+  gchar * kind;
+};
+
 struct _NPFridaClosure
 {
   GClosure closure;
   NPFridaNPObject * object;
-  NPObject * callback;
+  const gchar * signal_name;
+  GMutex mutex;
+  GPtrArray * listeners;
 };
 
 struct _NPFridaClosureInvocation
 {
   NPFridaClosure * closure;
+  GPtrArray * listeners;
   GArray * args;
+  guint message_index;
+  JsonParser * message;
 };
 
 static void npfrida_object_constructed (GObject * object);
 static void npfrida_object_dispose (GObject * object);
 static void npfrida_object_finalize (GObject * object);
 
-static gboolean npfrida_object_do_destroy (gpointer data);
+static void npfrida_object_do_destroy (NPFridaWorkItem * item);
+static bool npfrida_object_do_invoke (NPObject * npobj, NPIdentifier name, const NPVariant * args, uint32_t arg_count, NPVariant * result);
+static bool npfrida_object_read_property (NPObject * npobj, NPIdentifier name, NPVariant * result);
 static void npfrida_object_destroy_ready (GObject * source_object, GAsyncResult * res, gpointer user_data);
-static gboolean npfrida_object_begin_invoke (gpointer user_data);
+static void npfrida_object_begin_invoke (NPFridaWorkItem * item);
 static void npfrida_object_on_invoke_ready (GObject * source_object, GAsyncResult * res, gpointer user_data);
+static gboolean npfrida_object_on_invoke_timeout (gpointer user_data);
 static void npfrida_object_end_invoke (void * data);
-static gboolean npfrida_object_do_get_property (gpointer data);
+static NPFridaInvokeContext * npfrida_invoke_context_ref (NPFridaInvokeContext * ctx);
+static void npfrida_invoke_context_unref (NPFridaInvokeContext * ctx);
+static void npfrida_object_do_get_property (NPFridaWorkItem * item);
 static bool npfrida_object_add_event_listener (NPObject * npobj, const NPVariant * args, uint32_t arg_count, NPVariant * result);
+static bool npfrida_object_set_call_timeout (NPObject * npobj, const NPVariant * args, uint32_t arg_count, NPVariant * result);
+static bool npfrida_object_get_stats (NPObject * npobj, const NPVariant * args, uint32_t arg_count, NPVariant * result);
+static bool npfrida_object_dump_trace (NPObject * npobj, const NPVariant * args, uint32_t arg_count, NPVariant * result);
+static gboolean npfrida_object_parse_call_options (NPFridaObject * self, NPObject * options, guint * timeout);
 
-static GVariant * npfrida_object_argument_list_to_gvariant (NPFridaObject * self, const NPVariant * args, guint arg_count, GError ** err);
 static void npfrida_object_return_value_to_npvariant (NPFridaObject * self, GVariant * retval, NPVariant * result);
-static void npfrida_object_gvariant_to_npvariant (NPFridaObject * self, GVariant * retval, NPVariant * result);
 
-static gboolean npfrida_object_gvalue_to_npvariant (NPFridaObject * self, const GValue * gvalue, NPVariant * result);
+static NPFridaListener * npfrida_listener_new (NPObject * callback);
+static NPFridaListener * npfrida_listener_ref (NPFridaListener * listener);
+static void npfrida_listener_unref (gpointer data);
+static gboolean npfrida_listener_parse_filter (NPFridaListener * self, NPP npp, NPObject * filter, guint signal_id, const gchar ** error_message);
+static gboolean npfrida_listener_matches (NPFridaListener * self, const GValue * param_values, guint n_param_values, JsonParser ** message);
 
-static GClosure * npfrida_closure_new (NPFridaNPObject * object, NPObject * callback);
+static guint npfrida_closure_find_message (const GValue * param_values, guint n_param_values);
+static NPFridaClosure * npfrida_closure_new (NPFridaNPObject * object, guint signal_id);
 static void npfrida_closure_finalize (gpointer data, GClosure * closure);
 static void npfrida_closure_marshal (GClosure * closure, GValue * return_gvalue,
     guint n_param_values, const GValue * param_values, gpointer invocation_hint, gpointer marshal_data);
@@ -106,6 +168,9 @@ npfrida_object_init (NPFridaObject * self)
   self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self, NPFRIDA_TYPE_OBJECT, NPFridaObjectPrivate);
 
   g_cond_init (&self->priv->cond);
+  self->priv->closures = g_hash_table_new (NULL, NULL);
+  self->priv->call_timeouts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  self->priv->stats = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, npfrida_method_stats_free);
 }
 
 static void
@@ -137,6 +202,18 @@ npfrida_object_dispose (GObject * object)
     priv->json = NULL;
   }
 
+  if (priv->browser_queue != NULL)
+  {
+    npfrida_browser_queue_unref (priv->browser_queue);
+    priv->browser_queue = NULL;
+  }
+
+  if (priv->work_queue != NULL)
+  {
+    npfrida_work_queue_unref (priv->work_queue);
+    priv->work_queue = NULL;
+  }
+
   G_OBJECT_CLASS (npfrida_object_parent_class)->dispose (object);
 }
 
@@ -146,6 +223,9 @@ npfrida_object_finalize (GObject * object)
   NPFridaObject * self = NPFRIDA_OBJECT (object);
 
   g_cond_clear (&self->priv->cond);
+  g_hash_table_unref (self->priv->closures);
+  g_hash_table_unref (self->priv->call_timeouts);
+  g_hash_table_unref (self->priv->stats);
 
   G_OBJECT_CLASS (npfrida_object_parent_class)->finalize (object);
 }
@@ -154,30 +234,28 @@ void
 npfrida_np_object_destroy (NPFridaNPObject * obj)
 {
   NPFridaDestroyContext ctx = { 0, };
-  GSource * source;
+  gint64 start;
 
   ctx.self = obj->g_object;
 
-  source = g_idle_source_new ();
-  g_source_set_priority (source, G_PRIORITY_LOW);
-  g_source_set_callback (source, npfrida_object_do_destroy, &ctx, NULL);
-  g_source_attach (source, npfrida_main_context);
-  g_source_unref (source);
+  start = NPFRIDA_TRACE_BEGIN ();
+
+  npfrida_work_queue_submit (ctx.self->priv->work_queue, NPFRIDA_WORK_TEARDOWN, &ctx.work, npfrida_object_do_destroy);
 
   G_LOCK (npfrida_object);
   while (!ctx.completed)
     g_cond_wait (&ctx.self->priv->cond, &G_LOCK_NAME (npfrida_object));
   G_UNLOCK (npfrida_object);
+
+  NPFRIDA_TRACE_END ("wait", "destroy", NULL, start);
 }
 
-static gboolean
-npfrida_object_do_destroy (gpointer data)
+static void
+npfrida_object_do_destroy (NPFridaWorkItem * item)
 {
-  NPFridaDestroyContext * ctx = static_cast<NPFridaDestroyContext *> (data);
+  NPFridaDestroyContext * ctx = reinterpret_cast<NPFridaDestroyContext *> (item);
 
   NPFRIDA_OBJECT_GET_CLASS (ctx->self)->destroy (ctx->self, npfrida_object_destroy_ready, ctx);
-
-  return FALSE;
 }
 
 static void
@@ -212,6 +290,9 @@ npfrida_object_allocate (NPP npp, NPClass * klass)
   priv = obj->g_object->priv;
 
   priv->npp = npp;
+  priv->browser_queue = npfrida_browser_queue_ref (npfrida_plugin_get_browser_queue (npp));
+  priv->work_queue = npfrida_work_queue_ref (npfrida_plugin_get_work_queue (npp));
+  priv->lazy_json = npfrida_plugin_get_lazy_json (npp);
 
   error = browser->getvalue (npp, NPNVWindowNPObject, &window);
   g_assert (error == NPERR_NO_ERROR);
@@ -228,6 +309,8 @@ npfrida_object_deallocate (NPObject * npobj)
 {
   NPFridaNPObject * np_object = reinterpret_cast<NPFridaNPObject *> (npobj);
 
+  npfrida_record_forget (npobj);
+
   g_assert (np_object->g_object != NULL);
   g_object_unref (np_object->g_object);
   g_slice_free (NPFridaNPObject, np_object);
@@ -246,7 +329,10 @@ npfrida_object_has_method (NPObject * npobj, NPIdentifier name)
   const gchar * function_name;
 
   function_name = static_cast<NPString *> (name)->UTF8Characters;
-  if (strcmp (function_name, "addEventListener") == 0)
+  if (strcmp (function_name, "addEventListener") == 0 ||
+      strcmp (function_name, "setCallTimeout") == 0 ||
+      strcmp (function_name, "stats") == 0 ||
+      strcmp (function_name, "dumpTrace") == 0)
     return true;
 
   return npfrida_dispatcher_has_method (priv->dispatcher, static_cast<NPString *> (name)->UTF8Characters) != FALSE;
@@ -254,13 +340,40 @@ npfrida_object_has_method (NPObject * npobj, NPIdentifier name)
 
 static bool
 npfrida_object_invoke (NPObject * npobj, NPIdentifier name, const NPVariant * args, uint32_t arg_count, NPVariant * result)
+{
+  gint64 record_start;
+  bool success;
+
+  record_start = NPFRIDA_RECORD_BEGIN ();
+  if (record_start != 0)
+    VOID_TO_NPVARIANT (*result);
+
+  success = npfrida_object_do_invoke (npobj, name, args, arg_count, result);
+
+  if (record_start != 0)
+  {
+    npfrida_record_call (NPFRIDA_RECORD_INVOKE, reinterpret_cast<NPFridaNPObject *> (npobj)->g_object->priv->npp, npobj, name,
+        args, arg_count, result, record_start);
+  }
+
+  return success;
+}
+
+static bool
+npfrida_object_do_invoke (NPObject * npobj, NPIdentifier name, const NPVariant * args, uint32_t arg_count, NPVariant * result)
 {
   const gchar * function_name;
   NPFridaObject * self;
   GVariant * arguments = NULL;
+  NPFridaPreparedCall * call;
   GError * error = NULL;
+  gint arity;
+  guint timeout;
+  NPFridaMethodStats * stats;
+  gint64 start_time;
   NPFridaInvokeContext * ctx;
-  GSource * source;
+
+  start_time = g_get_monotonic_time ();
 
   function_name = static_cast<NPString *> (name)->UTF8Characters;
 
@@ -268,31 +381,70 @@ npfrida_object_invoke (NPObject * npobj, NPIdentifier name, const NPVariant * ar
   {
     return npfrida_object_add_event_listener (npobj, args, arg_count, result);
   }
+  else if (strcmp (function_name, "setCallTimeout") == 0)
+  {
+    return npfrida_object_set_call_timeout (npobj, args, arg_count, result);
+  }
+  else if (strcmp (function_name, "stats") == 0)
+  {
+    return npfrida_object_get_stats (npobj, args, arg_count, result);
+  }
+  else if (strcmp (function_name, "dumpTrace") == 0)
+  {
+    return npfrida_object_dump_trace (npobj, args, arg_count, result);
+  }
 
   self = reinterpret_cast<NPFridaNPObject *> (npobj)->g_object;
 
+  timeout = GPOINTER_TO_UINT (g_hash_table_lookup (self->priv->call_timeouts, function_name));
+  if (timeout == 0)
+    timeout = self->priv->default_call_timeout;
+
+  arity = npfrida_dispatcher_get_arity (self->priv->dispatcher, function_name);
+  if (arity >= 0 && arg_count == static_cast<guint> (arity) + 1 && args[arity].type == NPVariantType_Object)
+  {
+    if (!npfrida_object_parse_call_options (self, NPVARIANT_TO_OBJECT (args[arity]), &timeout))
+    {
+      g_set_error (&error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "invalid call options");
+      goto invoke_failed;
+    }
+    arg_count--;
+  }
+
   arguments = npfrida_object_argument_list_to_gvariant (self, args, arg_count, &error);
   if (error != NULL)
     goto invoke_failed;
 
-  npfrida_dispatcher_validate_invoke (self->priv->dispatcher, function_name, arguments, &error);
+  call = npfrida_dispatcher_prepare_invoke (self->priv->dispatcher, function_name, arguments, &error);
+  g_variant_unref (arguments);
+  arguments = NULL;
   if (error != NULL)
     goto invoke_failed;
 
   ctx = g_slice_new0 (NPFridaInvokeContext);
-  ctx->function_name = g_strdup (function_name);
-  ctx->arguments = arguments;
+  ctx->ref_count = 1;
+  ctx->self = NPFRIDA_OBJECT (g_object_ref (self));
+  ctx->function_name = npfrida_prepared_call_get_name (call);
+  ctx->call = call;
+  ctx->cancellable = g_cancellable_new ();
+  ctx->timeout = timeout;
+  stats = static_cast<NPFridaMethodStats *> (g_hash_table_lookup (self->priv->stats, function_name));
+  if (stats == NULL)
+  {
+    stats = npfrida_method_stats_new ();
+    g_hash_table_insert (self->priv->stats, g_strdup (function_name), stats);
+  }
+  ctx->stats = stats;
+  ctx->start_time = start_time;
   npfrida_nsfuncs->retainobject (npobj);
   ctx->promise = npfrida_promise_new (self->priv->npp, npobj, npfrida_npobject_release);
+  reinterpret_cast<NPFridaPromise *> (ctx->promise)->cancellable = G_CANCELLABLE (g_object_ref (ctx->cancellable));
 
   npfrida_nsfuncs->retainobject (ctx->promise);
   OBJECT_TO_NPVARIANT (ctx->promise, *result);
 
-  source = g_idle_source_new ();
-  g_source_set_priority (source, G_PRIORITY_HIGH);
-  g_source_set_callback (source, npfrida_object_begin_invoke, ctx, NULL);
-  g_source_attach (source, npfrida_main_context);
-  g_source_unref (source);
+  ctx->submit_time = g_get_monotonic_time ();
+  npfrida_work_queue_submit (self->priv->work_queue, NPFRIDA_WORK_CALL, &ctx->work, npfrida_object_begin_invoke);
 
   return true;
 
@@ -306,30 +458,88 @@ invoke_failed:
   }
 }
 
-static gboolean
-npfrida_object_begin_invoke (gpointer user_data)
+static void
+npfrida_object_begin_invoke (NPFridaWorkItem * item)
 {
-  NPFridaInvokeContext * ctx = static_cast<NPFridaInvokeContext *> (user_data);
-  NPFridaPromise * promise = reinterpret_cast<NPFridaPromise *> (ctx->promise);
-  NPFridaObject * self = static_cast<NPFridaNPObject *> (promise->user_data)->g_object;
+  NPFridaInvokeContext * ctx = reinterpret_cast<NPFridaInvokeContext *> (item);
 
-  npfrida_dispatcher_invoke (self->priv->dispatcher, ctx->function_name, ctx->arguments,
-      npfrida_object_on_invoke_ready, ctx);
+  ctx->begin_time = g_get_monotonic_time ();
 
-  return FALSE;
+  if (ctx->timeout != 0)
+  {
+    ctx->timeout_source = g_timeout_source_new (ctx->timeout);
+    g_source_set_callback (ctx->timeout_source, npfrida_object_on_invoke_timeout, ctx, NULL);
+    g_source_attach (ctx->timeout_source, npfrida_main_context);
+  }
+
+  npfrida_dispatcher_invoke (ctx->self->priv->dispatcher, ctx->call, ctx->cancellable,
+      npfrida_object_on_invoke_ready, npfrida_invoke_context_ref (ctx));
 }
 
 static void
 npfrida_object_on_invoke_ready (GObject * source_object, GAsyncResult * res, gpointer user_data)
 {
   NPFridaInvokeContext * ctx = static_cast<NPFridaInvokeContext *> (user_data);
-  NPFridaPromise * promise = reinterpret_cast<NPFridaPromise *> (ctx->promise);
-  NPFridaObject * self = static_cast<NPFridaNPObject *> (promise->user_data)->g_object;
+  GVariant * retval;
+  GError * error = NULL;
 
   (void) source_object;
 
-  ctx->retval = npfrida_dispatcher_invoke_finish (self->priv->dispatcher, res, &ctx->error);
-  npfrida_nsfuncs->pluginthreadasynccall (self->priv->npp, npfrida_object_end_invoke, ctx);
+  if (ctx->timeout_source != NULL)
+  {
+    g_source_destroy (ctx->timeout_source);
+    g_source_unref (ctx->timeout_source);
+    ctx->timeout_source = NULL;
+  }
+
+  retval = npfrida_dispatcher_invoke_finish (ctx->self->priv->dispatcher, res, &error);
+
+  if (!ctx->settled)
+  {
+    ctx->settled = TRUE;
+    ctx->ready_time = g_get_monotonic_time ();
+    if (npfrida_trace_enabled)
+      npfrida_trace_record ("frida", ctx->function_name, NULL, ctx->begin_time, ctx->ready_time);
+    ctx->retval = retval;
+    ctx->error = error;
+    if (retval != NULL && !ctx->self->priv->lazy_json && g_variant_type_is_array (g_variant_get_type (retval)))
+    {
+      /* Without lazy materialization lists are handed to JSON.parse like any other result */
+      ctx->retval = g_variant_new_take_string (npfrida_json_from_variant (retval));
+      g_variant_ref_sink (ctx->retval);
+      g_variant_unref (retval);
+    }
+    /* Parse here rather than calling JSON.parse on the browser thread, objects are materialized on access */
+    if (ctx->self->priv->lazy_json && retval != NULL && g_variant_is_of_type (retval, G_VARIANT_TYPE_STRING))
+      ctx->document = npfrida_json_document_parse (g_variant_get_string (retval, NULL));
+    npfrida_browser_queue_push (ctx->self->priv->browser_queue, npfrida_object_end_invoke, ctx);
+  }
+  else
+  {
+    if (retval != NULL)
+      g_variant_unref (retval);
+    g_clear_error (&error);
+  }
+
+  npfrida_invoke_context_unref (ctx);
+}
+
+static gboolean
+npfrida_object_on_invoke_timeout (gpointer user_data)
+{
+  NPFridaInvokeContext * ctx = static_cast<NPFridaInvokeContext *> (user_data);
+
+  g_source_unref (ctx->timeout_source);
+  ctx->timeout_source = NULL;
+
+  /* The promise is rejected right away, whether or not the backend honors the cancellation */
+  ctx->settled = TRUE;
+  ctx->ready_time = g_get_monotonic_time ();
+  g_set_error (&ctx->error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT, "timed out");
+  g_cancellable_cancel (ctx->cancellable);
+  npfrida_browser_queue_push (ctx->self->priv->browser_queue, npfrida_object_end_invoke, ctx);
+
+  return FALSE;
 }
 
 static void
@@ -337,38 +547,79 @@ npfrida_object_end_invoke (void * data)
 {
   NPFridaInvokeContext * ctx = static_cast<NPFridaInvokeContext *> (data);
   NPFridaPromise * promise = reinterpret_cast<NPFridaPromise *> (ctx->promise);
-  NPFridaObject * self = static_cast<NPFridaNPObject *> (promise->user_data)->g_object;
+  gint64 end_time, finish_time;
+
+  end_time = g_get_monotonic_time ();
 
   if (ctx->error == NULL)
   {
     if (ctx->retval == NULL)
     {
-      npfrida_promise_resolve (promise, NULL, 0);
+      npfrida_promise_complete (promise, NPFRIDA_PROMISE_SUCCESS, NULL, 0);
     }
     else
     {
       NPVariant val;
-      npfrida_object_return_value_to_npvariant (self, ctx->retval, &val);
-      npfrida_promise_resolve (promise, &val, 1);
-      npfrida_nsfuncs->releasevariantvalue (&val);
+      if (ctx->document != NULL)
+        npfrida_json_document_to_npvariant (ctx->document, ctx->self->priv->npp, &val);
+      else
+        npfrida_object_return_value_to_npvariant (ctx->self, ctx->retval, &val);
+      npfrida_promise_complete (promise, NPFRIDA_PROMISE_SUCCESS, &val, 1);
     }
   }
   else
   {
     NPVariant message;
 
-    STRINGZ_TO_NPVARIANT (ctx->error->message, message);
-    npfrida_promise_reject (promise, &message, 1);
+    npfrida_init_npvariant_with_string (&message, ctx->error->message);
+    npfrida_promise_complete (promise, NPFRIDA_PROMISE_FAILURE, &message, 1);
   }
 
-  g_free (ctx->function_name);
-  if (ctx->arguments != NULL)
-    g_variant_unref (ctx->arguments);
+  finish_time = g_get_monotonic_time ();
+  if (npfrida_trace_enabled)
+    npfrida_trace_record ("invoke", "invoke", ctx->function_name, ctx->start_time, finish_time);
+  npfrida_method_stats_count_call (ctx->stats, ctx->error == NULL);
+  npfrida_method_stats_record (ctx->stats, NPFRIDA_STATS_MARSHAL, ctx->submit_time - ctx->start_time);
+  npfrida_method_stats_record (ctx->stats, NPFRIDA_STATS_QUEUE_WAIT, ctx->begin_time - ctx->submit_time);
+  npfrida_method_stats_record (ctx->stats, NPFRIDA_STATS_EXECUTE, ctx->ready_time - ctx->begin_time);
+  npfrida_method_stats_record (ctx->stats, NPFRIDA_STATS_BROWSER_WAIT, end_time - ctx->ready_time);
+  npfrida_method_stats_record (ctx->stats, NPFRIDA_STATS_CONVERT, finish_time - end_time);
+  npfrida_method_stats_record (ctx->stats, NPFRIDA_STATS_TOTAL, finish_time - ctx->start_time);
+
   npfrida_nsfuncs->releaseobject (ctx->promise);
-  if (ctx->retval != NULL)
-    g_variant_unref (ctx->retval);
-  g_clear_error (&ctx->error);
-  g_slice_free (NPFridaInvokeContext, ctx);
+  ctx->promise = NULL;
+  if (ctx->call != NULL)
+  {
+    g_object_unref (ctx->call);
+    ctx->call = NULL;
+  }
+
+  npfrida_invoke_context_unref (ctx);
+}
+
+static NPFridaInvokeContext *
+npfrida_invoke_context_ref (NPFridaInvokeContext * ctx)
+{
+  g_atomic_int_inc (&ctx->ref_count);
+  return ctx;
+}
+
+static void
+npfrida_invoke_context_unref (NPFridaInvokeContext * ctx)
+{
+  if (g_atomic_int_dec_and_test (&ctx->ref_count))
+  {
+    g_object_unref (ctx->self);
+    if (ctx->call != NULL)
+      g_object_unref (ctx->call);
+    g_object_unref (ctx->cancellable);
+    if (ctx->retval != NULL)
+      g_variant_unref (ctx->retval);
+    if (ctx->document != NULL)
+      g_object_unref (ctx->document);
+    g_clear_error (&ctx->error);
+    g_slice_free (NPFridaInvokeContext, ctx);
+  }
 }
 
 static bool
@@ -394,12 +645,33 @@ npfrida_object_has_property (NPObject * npobj, NPIdentifier name)
 
 static bool
 npfrida_object_get_property (NPObject * npobj, NPIdentifier name, NPVariant * result)
+{
+  gint64 record_start;
+  bool success;
+
+  record_start = NPFRIDA_RECORD_BEGIN ();
+  if (record_start != 0)
+    VOID_TO_NPVARIANT (*result);
+
+  success = npfrida_object_read_property (npobj, name, result);
+
+  if (record_start != 0)
+  {
+    npfrida_record_call (NPFRIDA_RECORD_GET_PROPERTY, reinterpret_cast<NPFridaNPObject *> (npobj)->g_object->priv->npp, npobj, name,
+        NULL, 0, result, record_start);
+  }
+
+  return success;
+}
+
+static bool
+npfrida_object_read_property (NPObject * npobj, NPIdentifier name, NPVariant * result)
 {
   NPFridaNPObject * np_object = reinterpret_cast<NPFridaNPObject *> (npobj);
   NPFridaNPObjectClass * np_class = reinterpret_cast<NPFridaNPObjectClass *> (npobj->_class);
   NPFridaGetPropertyContext ctx = { 0, };
   GParamSpec * spec;
-  GSource * source;
+  gint64 start;
 
   ctx.self = np_object->g_object;
 
@@ -409,17 +681,17 @@ npfrida_object_get_property (NPObject * npobj, NPIdentifier name, NPVariant * re
     goto no_such_property;
   g_value_init (&ctx.value, spec->value_type);
 
-  source = g_idle_source_new ();
-  g_source_set_priority (source, G_PRIORITY_HIGH);
-  g_source_set_callback (source, npfrida_object_do_get_property, &ctx, NULL);
-  g_source_attach (source, npfrida_main_context);
-  g_source_unref (source);
+  start = NPFRIDA_TRACE_BEGIN ();
+
+  npfrida_work_queue_submit (ctx.self->priv->work_queue, NPFRIDA_WORK_INTERACTIVE, &ctx.work, npfrida_object_do_get_property);
 
   G_LOCK (npfrida_object);
   while (!ctx.completed)
     g_cond_wait (&ctx.self->priv->cond, &G_LOCK_NAME (npfrida_object));
   G_UNLOCK (npfrida_object);
 
+  NPFRIDA_TRACE_END ("wait", "getProperty", g_param_spec_get_name (spec), start);
+
   if (!npfrida_object_gvalue_to_npvariant (ctx.self, &ctx.value, result))
     goto cannot_marshal;
   g_value_unset (&ctx.value);
@@ -440,10 +712,10 @@ cannot_marshal:
   }
 }
 
-static gboolean
-npfrida_object_do_get_property (gpointer data)
+static void
+npfrida_object_do_get_property (NPFridaWorkItem * item)
 {
-  NPFridaGetPropertyContext * ctx = static_cast<NPFridaGetPropertyContext *> (data);
+  NPFridaGetPropertyContext * ctx = reinterpret_cast<NPFridaGetPropertyContext *> (item);
   NPFridaObjectPrivate * priv = ctx->self->priv;
 
   g_object_get_property (G_OBJECT (ctx->self), ctx->property_name, &ctx->value);
@@ -452,20 +724,23 @@ npfrida_object_do_get_property (gpointer data)
   ctx->completed = TRUE;
   g_cond_signal (&priv->cond);
   G_UNLOCK (npfrida_object);
-
-  return FALSE;
 }
 
 static bool
 npfrida_object_add_event_listener (NPObject * npobj, const NPVariant * args, uint32_t arg_count, NPVariant * result)
 {
-  const NPVariant * signal_name, * signal_handler;
+  NPFridaNPObject * np_object = reinterpret_cast<NPFridaNPObject *> (npobj);
+  NPFridaObjectPrivate * priv = np_object->g_object->priv;
+  const NPVariant * signal_name, * signal_handler, * signal_filter;
   gchar * signal_name_str;
   guint signal_id;
+  NPFridaListener * listener;
+  const gchar * error_message;
+  NPFridaClosure * closure;
 
-  if (arg_count != 2)
+  if (arg_count != 2 && arg_count != 3)
   {
-    npfrida_nsfuncs->setexception (npobj, "addEventListener requires two arguments");
+    npfrida_nsfuncs->setexception (npobj, "addEventListener requires two or three arguments");
     return true;
   }
 
@@ -483,10 +758,17 @@ npfrida_object_add_event_listener (NPObject * npobj, const NPVariant * args, uin
     return true;
   }
 
+  signal_filter = (arg_count == 3) ? &args[2] : NULL;
+  if (signal_filter != NULL && signal_filter->type != NPVariantType_Object)
+  {
+    npfrida_nsfuncs->setexception (npobj, "event filter must be an object");
+    return true;
+  }
+
   signal_name_str = (gchar *) g_malloc (signal_name->value.stringValue.UTF8Length + 1);
   memcpy (signal_name_str, signal_name->value.stringValue.UTF8Characters, signal_name->value.stringValue.UTF8Length);
   signal_name_str[signal_name->value.stringValue.UTF8Length] = '\0';
-  signal_id = g_signal_lookup (signal_name_str, G_OBJECT_TYPE (reinterpret_cast<NPFridaNPObject *> (npobj)->g_object));
+  signal_id = g_signal_lookup (signal_name_str, G_OBJECT_TYPE (np_object->g_object));
   g_free (signal_name_str), signal_name_str = NULL;
 
   if (signal_id == 0)
@@ -495,14 +777,193 @@ npfrida_object_add_event_listener (NPObject * npobj, const NPVariant * args, uin
     return true;
   }
 
-  g_signal_connect_closure_by_id (reinterpret_cast<NPFridaNPObject *> (npobj)->g_object, signal_id, 0,
-      npfrida_closure_new (reinterpret_cast<NPFridaNPObject *> (npobj), signal_handler->value.objectValue), TRUE);
+  listener = npfrida_listener_new (signal_handler->value.objectValue);
+  if (signal_filter != NULL &&
+      !npfrida_listener_parse_filter (listener, priv->npp, signal_filter->value.objectValue, signal_id, &error_message))
+  {
+    npfrida_listener_unref (listener);
+    npfrida_nsfuncs->setexception (npobj, error_message);
+    return true;
+  }
+
+  closure = static_cast<NPFridaClosure *> (g_hash_table_lookup (priv->closures, GUINT_TO_POINTER (signal_id)));
+  if (closure == NULL)
+  {
+    closure = npfrida_closure_new (np_object, signal_id);
+    g_hash_table_insert (priv->closures, GUINT_TO_POINTER (signal_id), closure);
+    g_signal_connect_closure_by_id (np_object->g_object, signal_id, 0, &closure->closure, TRUE);
+  }
+
+  g_mutex_lock (&closure->mutex);
+  g_ptr_array_add (closure->listeners, listener);
+  g_mutex_unlock (&closure->mutex);
 
   VOID_TO_NPVARIANT (*result);
   return true;
 }
 
-static GVariant *
+static gboolean
+npfrida_object_variant_to_timeout (const NPVariant * variant, guint * timeout)
+{
+  if (variant->type == NPVariantType_Int32 && NPVARIANT_TO_INT32 (*variant) >= 0)
+    *timeout = NPVARIANT_TO_INT32 (*variant);
+  else if (variant->type == NPVariantType_Double && NPVARIANT_TO_DOUBLE (*variant) >= 0)
+    *timeout = (NPVARIANT_TO_DOUBLE (*variant) < G_MAXUINT) ? (guint) NPVARIANT_TO_DOUBLE (*variant) : G_MAXUINT;
+  else
+    return FALSE;
+
+  return TRUE;
+}
+
+static bool
+npfrida_object_set_call_timeout (NPObject * npobj, const NPVariant * args, uint32_t arg_count, NPVariant * result)
+{
+  NPFridaObjectPrivate * priv = reinterpret_cast<NPFridaNPObject *> (npobj)->g_object->priv;
+  guint timeout;
+
+  if (arg_count == 1)
+  {
+    if (!npfrida_object_variant_to_timeout (&args[0], &timeout))
+    {
+      npfrida_nsfuncs->setexception (npobj, "timeout must be a non-negative number of milliseconds");
+      return true;
+    }
+
+    priv->default_call_timeout = timeout;
+  }
+  else if (arg_count == 2)
+  {
+    gchar * method_name;
+
+    if (args[0].type != NPVariantType_String)
+    {
+      npfrida_nsfuncs->setexception (npobj, "method name must be a string");
+      return true;
+    }
+
+    if (!npfrida_object_variant_to_timeout (&args[1], &timeout))
+    {
+      npfrida_nsfuncs->setexception (npobj, "timeout must be a non-negative number of milliseconds");
+      return true;
+    }
+
+    method_name = npfrida_npstring_to_cstring (&NPVARIANT_TO_STRING (args[0]));
+    if (npfrida_dispatcher_get_arity (priv->dispatcher, method_name) < 0)
+    {
+      g_free (method_name);
+      npfrida_nsfuncs->setexception (npobj, "no such method");
+      return true;
+    }
+
+    if (timeout != 0)
+    {
+      g_hash_table_insert (priv->call_timeouts, method_name, GUINT_TO_POINTER (timeout));
+    }
+    else
+    {
+      g_hash_table_remove (priv->call_timeouts, method_name);
+      g_free (method_name);
+    }
+  }
+  else
+  {
+    npfrida_nsfuncs->setexception (npobj, "setCallTimeout requires one or two arguments");
+    return true;
+  }
+
+  VOID_TO_NPVARIANT (*result);
+  return true;
+}
+
+static bool
+npfrida_object_get_stats (NPObject * npobj, const NPVariant * args, uint32_t arg_count, NPVariant * result)
+{
+  NPFridaObjectPrivate * priv = reinterpret_cast<NPFridaNPObject *> (npobj)->g_object->priv;
+  JsonBuilder * builder;
+  JsonGenerator * generator;
+  JsonNode * root;
+  GHashTableIter iter;
+  const gchar * method_name;
+  NPFridaMethodStats * stats;
+  gchar * json;
+  NPVariant variant;
+
+  (void) args;
+
+  if (arg_count != 0)
+  {
+    npfrida_nsfuncs->setexception (npobj, "stats takes no arguments");
+    return true;
+  }
+
+  builder = json_builder_new ();
+  json_builder_begin_object (builder);
+  g_hash_table_iter_init (&iter, priv->stats);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &method_name, (gpointer *) &stats))
+  {
+    json_builder_set_member_name (builder, method_name);
+    npfrida_method_stats_serialize (stats, builder);
+  }
+  json_builder_end_object (builder);
+
+  root = json_builder_get_root (builder);
+  generator = json_generator_new ();
+  json_generator_set_root (generator, root);
+  json = json_generator_to_data (generator, NULL);
+  g_object_unref (generator);
+  json_node_free (root);
+  g_object_unref (builder);
+
+  STRINGZ_TO_NPVARIANT (json, variant);
+  VOID_TO_NPVARIANT (*result);
+  npfrida_nsfuncs->invoke (priv->npp, priv->json, npfrida_nsfuncs->getstringidentifier ("parse"), &variant, 1, result);
+  g_free (json);
+
+  return true;
+}
+
+static bool
+npfrida_object_dump_trace (NPObject * npobj, const NPVariant * args, uint32_t arg_count, NPVariant * result)
+{
+  GError * error = NULL;
+
+  (void) args;
+
+  /* Pages only choose when to write, never where: the path comes from NPFRIDA_TRACE */
+  if (arg_count != 0)
+  {
+    npfrida_nsfuncs->setexception (npobj, "dumpTrace takes no arguments");
+    return true;
+  }
+
+  if (!npfrida_trace_dump (&error))
+  {
+    npfrida_nsfuncs->setexception (npobj, error->message);
+    g_clear_error (&error);
+  }
+
+  VOID_TO_NPVARIANT (*result);
+  return true;
+}
+
+static gboolean
+npfrida_object_parse_call_options (NPFridaObject * self, NPObject * options, guint * timeout)
+{
+  NPVariant variant;
+  gboolean valid;
+
+  VOID_TO_NPVARIANT (variant);
+  if (!npfrida_nsfuncs->getproperty (self->priv->npp, options, npfrida_nsfuncs->getstringidentifier ("timeout"), &variant))
+    return FALSE;
+
+  valid = variant.type == NPVariantType_Void || npfrida_object_variant_to_timeout (&variant, timeout);
+
+  npfrida_nsfuncs->releasevariantvalue (&variant);
+
+  return valid;
+}
+
+GVariant *
 npfrida_object_argument_list_to_gvariant (NPFridaObject * self, const NPVariant * args, guint arg_count, GError ** err)
 {
   GVariantBuilder builder;
@@ -529,9 +990,9 @@ npfrida_object_argument_list_to_gvariant (NPFridaObject * self, const NPVariant
       {
         gchar * str;
 
+        /* The variant adopts our copy, so the bytes are only duplicated once */
         str = npfrida_npstring_to_cstring (&var->value.stringValue);
-        g_variant_builder_add_value (&builder, g_variant_new_string (str));
-        g_free (str);
+        g_variant_builder_add_value (&builder, g_variant_new_take_string (str));
 
         break;
       }
@@ -545,8 +1006,7 @@ npfrida_object_argument_list_to_gvariant (NPFridaObject * self, const NPVariant
           gchar * str;
 
           str = npfrida_npstring_to_cstring (&result.value.stringValue);
-          g_variant_builder_add_value (&builder, g_variant_new_string (str));
-          g_free (str);
+          g_variant_builder_add_value (&builder, g_variant_new_take_string (str));
 
           npfrida_nsfuncs->releasevariantvalue (&result);
 
@@ -581,7 +1041,7 @@ npfrida_object_return_value_to_npvariant (NPFridaObject * self, GVariant * retva
   npfrida_object_gvariant_to_npvariant (self, retval, result);
 }
 
-static void
+void
 npfrida_object_gvariant_to_npvariant (NPFridaObject * self, GVariant * retval, NPVariant * result)
 {
   const GVariantType * type;
@@ -603,6 +1063,10 @@ npfrida_object_gvariant_to_npvariant (NPFridaObject * self, GVariant * retval, N
   {
     DOUBLE_TO_NPVARIANT (g_variant_get_double (retval), *result);
   }
+  else if (g_variant_type_is_array (type))
+  {
+    OBJECT_TO_NPVARIANT (npfrida_list_new (self->priv->npp, retval), *result);
+  }
   else if (g_variant_type_equal (type, G_VARIANT_TYPE_STRING))
   {
     NPVariant variant;
@@ -616,7 +1080,7 @@ npfrida_object_gvariant_to_npvariant (NPFridaObject * self, GVariant * retval, N
   }
 }
 
-static gboolean
+gboolean
 npfrida_object_gvalue_to_npvariant (NPFridaObject * self, const GValue * gvalue, NPVariant * result)
 {
   switch (G_VALUE_TYPE (gvalue))
@@ -736,8 +1200,219 @@ npfrida_object_type_get_np_class (GType gtype)
   return np_class;
 }
 
-static GClosure *
-npfrida_closure_new (NPFridaNPObject * object, NPObject * callback)
+static NPFridaListener *
+npfrida_listener_new (NPObject * callback)
+{
+  NPFridaListener * listener;
+
+  listener = g_slice_new0 (NPFridaListener);
+  listener->ref_count = 1;
+  listener->callback = npfrida_nsfuncs->retainobject (callback);
+
+  return listener;
+}
+
+static NPFridaListener *
+npfrida_listener_ref (NPFridaListener * listener)
+{
+  g_atomic_int_inc (&listener->ref_count);
+  return listener;
+}
+
+static void
+npfrida_listener_unref (gpointer data)
+{
+  NPFridaListener * listener = static_cast<NPFridaListener *> (data);
+
+  if (g_atomic_int_dec_and_test (&listener->ref_count))
+  {
+    npfrida_nsfuncs->releaseobject (listener->callback);
+    g_free (listener->type);
+    g_free (listener->kind);
+    g_slice_free (NPFridaListener, listener);
+  }
+}
+
+static gboolean
+npfrida_listener_get_uint_member (NPP npp, NPObject * filter, const gchar * name, gboolean * present, guint * value)
+{
+  NPVariant variant;
+  gboolean valid = TRUE;
+
+  VOID_TO_NPVARIANT (variant);
+  if (!npfrida_nsfuncs->getproperty (npp, filter, npfrida_nsfuncs->getstringidentifier (name), &variant))
+    return FALSE;
+
+  switch (variant.type)
+  {
+    case NPVariantType_Void:
+      *present = FALSE;
+      break;
+    case NPVariantType_Int32:
+      *present = TRUE;
+      *value = NPVARIANT_TO_INT32 (variant);
+      valid = NPVARIANT_TO_INT32 (variant) >= 0;
+      break;
+    case NPVariantType_Double:
+    {
+      double d = NPVARIANT_TO_DOUBLE (variant);
+
+      /* Also rejects NaN, which fails both comparisons */
+      *present = TRUE;
+      valid = d >= 0 && d <= G_MAXUINT;
+      if (valid)
+        *value = (guint) d;
+      break;
+    }
+    default:
+      valid = FALSE;
+      break;
+  }
+
+  npfrida_nsfuncs->releasevariantvalue (&variant);
+
+  return valid;
+}
+
+static gboolean
+npfrida_listener_get_string_member (NPP npp, NPObject * filter, const gchar * name, gchar ** value)
+{
+  NPVariant variant;
+  gboolean valid = TRUE;
+
+  VOID_TO_NPVARIANT (variant);
+  if (!npfrida_nsfuncs->getproperty (npp, filter, npfrida_nsfuncs->getstringidentifier (name), &variant))
+    return FALSE;
+
+  if (variant.type == NPVariantType_String)
+    *value = npfrida_npstring_to_cstring (&NPVARIANT_TO_STRING (variant));
+  else
+    valid = variant.type == NPVariantType_Void;
+
+  npfrida_nsfuncs->releasevariantvalue (&variant);
+
+  return valid;
+}
+
+static gboolean
+npfrida_listener_parse_filter (NPFridaListener * self, NPP npp, NPObject * filter, guint signal_id, const gchar ** error_message)
+{
+  GSignalQuery query;
+  gboolean has_target_params, has_text_param;
+  guint i;
+
+  if (!npfrida_listener_get_uint_member (npp, filter, "deviceId", &self->match_device_id, &self->device_id) ||
+      !npfrida_listener_get_uint_member (npp, filter, "pid", &self->match_pid, &self->pid) ||
+      !npfrida_listener_get_string_member (npp, filter, "type", &self->type) ||
+      !npfrida_listener_get_string_member (npp, filter, "kind", &self->kind))
+  {
+    *error_message = "invalid event filter";
+    return FALSE;
+  }
+
+  g_signal_query (signal_id, &query);
+
+  has_target_params = query.n_params >= 2 &&
+      (query.param_types[0] & ~G_SIGNAL_TYPE_STATIC_SCOPE) == G_TYPE_UINT &&
+      (query.param_types[1] & ~G_SIGNAL_TYPE_STATIC_SCOPE) == G_TYPE_UINT;
+  if ((self->match_device_id || self->match_pid) && !has_target_params)
+  {
+    *error_message = "event cannot be filtered by deviceId or pid";
+    return FALSE;
+  }
+
+  has_text_param = FALSE;
+  for (i = 0; i != query.n_params && !has_text_param; i++)
+    has_text_param = (query.param_types[i] & ~G_SIGNAL_TYPE_STATIC_SCOPE) == G_TYPE_STRING;
+  if ((self->type != NULL || self->kind != NULL) && !has_text_param)
+  {
+    *error_message = "event cannot be filtered by type or kind";
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static const gchar *
+npfrida_listener_get_json_string_member (JsonObject * object, const gchar * name)
+{
+  JsonNode * member;
+
+  member = json_object_get_member (object, name);
+  if (member == NULL || json_node_get_value_type (member) != G_TYPE_STRING)
+    return NULL;
+
+  return json_node_get_string (member);
+}
+
+static gboolean
+npfrida_listener_matches (NPFridaListener * self, const GValue * param_values, guint n_param_values, JsonParser ** message)
+{
+  JsonNode * root;
+  JsonObject * object, * payload;
+  const gchar * value;
+  guint message_index;
+
+  if (self->match_device_id && g_value_get_uint (&param_values[1]) != self->device_id)
+    return FALSE;
+  if (self->match_pid && g_value_get_uint (&param_values[2]) != self->pid)
+    return FALSE;
+
+  if (self->type == NULL && self->kind == NULL)
+    return TRUE;
+
+  /* Parsed at most once per emission and shared by all listeners */
+  if (*message == NULL)
+  {
+    *message = json_parser_new ();
+    message_index = npfrida_closure_find_message (param_values, n_param_values);
+    if (message_index != 0)
+      json_parser_load_from_data (*message, g_value_get_string (&param_values[message_index]), -1, NULL);
+  }
+
+  root = json_parser_get_root (*message);
+  if (root == NULL || !JSON_NODE_HOLDS_OBJECT (root))
+    return FALSE;
+  object = json_node_get_object (root);
+
+  if (self->type != NULL)
+  {
+    value = npfrida_listener_get_json_string_member (object, "type");
+    if (value == NULL || strcmp (value, self->type) != 0)
+      return FALSE;
+  }
+
+  if (self->kind != NULL)
+  {
+    if (!json_object_has_member (object, "payload") ||
+        !JSON_NODE_HOLDS_OBJECT (json_object_get_member (object, "payload")))
+      return FALSE;
+    payload = json_object_get_object_member (object, "payload");
+
+    value = npfrida_listener_get_json_string_member (payload, "kind");
+    if (value == NULL || strcmp (value, self->kind) != 0)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+static guint
+npfrida_closure_find_message (const GValue * param_values, guint n_param_values)
+{
+  guint i;
+
+  for (i = 1; i != n_param_values; i++)
+  {
+    if (G_VALUE_HOLDS_STRING (&param_values[i]))
+      return (g_value_get_string (&param_values[i]) != NULL) ? i : 0;
+  }
+
+  return 0;
+}
+
+static NPFridaClosure *
+npfrida_closure_new (NPFridaNPObject * object, guint signal_id)
 {
   GClosure * closure;
   NPFridaClosure * self;
@@ -746,11 +1421,13 @@ npfrida_closure_new (NPFridaNPObject * object, NPObject * callback)
   g_closure_add_finalize_notifier (closure, NULL, npfrida_closure_finalize);
   self = reinterpret_cast<NPFridaClosure *> (closure);
   self->object = object;
-  self->callback = npfrida_nsfuncs->retainobject (callback);
+  self->signal_name = g_signal_name (signal_id);
+  g_mutex_init (&self->mutex);
+  self->listeners = g_ptr_array_new_with_free_func (npfrida_listener_unref);
 
   g_closure_set_marshal (closure, npfrida_closure_marshal);
 
-  return closure;
+  return self;
 }
 
 static void
@@ -760,7 +1437,8 @@ npfrida_closure_finalize (gpointer data, GClosure * closure)
 
   (void) data;
 
-  npfrida_nsfuncs->releaseobject (self->callback);
+  g_ptr_array_unref (self->listeners);
+  g_mutex_clear (&self->mutex);
 }
 
 static void
@@ -769,23 +1447,60 @@ npfrida_closure_marshal (GClosure * closure, GValue * return_gvalue, guint n_par
 {
   NPFridaClosure * self = reinterpret_cast<NPFridaClosure *> (closure);
   NPFridaClosureInvocation * invocation;
+  GPtrArray * listeners = NULL;
+  JsonParser * message = NULL;
   guint i;
 
   (void) return_gvalue;
   (void) invocation_hint;
   (void) marshal_data;
 
+  g_mutex_lock (&self->mutex);
+  for (i = 0; i != self->listeners->len; i++)
+  {
+    NPFridaListener * listener = static_cast<NPFridaListener *> (g_ptr_array_index (self->listeners, i));
+
+    if (npfrida_listener_matches (listener, param_values, n_param_values, &message))
+    {
+      if (listeners == NULL)
+        listeners = g_ptr_array_new_with_free_func (npfrida_listener_unref);
+      g_ptr_array_add (listeners, npfrida_listener_ref (listener));
+    }
+  }
+  g_mutex_unlock (&self->mutex);
+
+  if (listeners == NULL || !self->object->g_object->priv->lazy_json)
+    g_clear_object (&message);
+
+  if (listeners == NULL)
+    return;
+
   invocation = g_slice_new (NPFridaClosureInvocation);
   invocation->closure = self;
+  g_closure_ref (closure);
+  invocation->listeners = listeners;
+  invocation->message_index = 0;
+  invocation->message = NULL;
+  if (self->object->g_object->priv->lazy_json)
+  {
+    invocation->message_index = npfrida_closure_find_message (param_values, n_param_values);
+    /* Reuse the document parsed for filtering, if any */
+    if (message != NULL && json_parser_get_root (message) == NULL)
+      g_clear_object (&message);
+    if (message == NULL && invocation->message_index != 0)
+      message = npfrida_json_document_parse (g_value_get_string (&param_values[invocation->message_index]));
+    invocation->message = message;
+  }
   invocation->args = g_array_sized_new (FALSE, FALSE, sizeof (GValue), n_param_values);
   for (i = 0; i != n_param_values; i++)
   {
     GValue val = { 0, };
+    g_value_init (&val, G_VALUE_TYPE (&param_values[i]));
     g_value_copy (&param_values[i], &val);
     g_array_append_val (invocation->args, val);
   }
 
-  npfrida_nsfuncs->pluginthreadasynccall (self->object->g_object->priv->npp, npfrida_closure_invoke, invocation);
+  npfrida_browser_queue_push (self->object->g_object->priv->browser_queue, npfrida_closure_invoke, invocation);
 }
 
 static void
@@ -796,24 +1511,30 @@ npfrida_closure_invoke (void * data)
   NPVariant * args;
   guint arg_count = invocation->args->len - 1;
   gboolean success = TRUE;
+  gint64 start;
   guint i;
 
+  start = NPFRIDA_TRACE_BEGIN ();
+
   args = static_cast<NPVariant *> (g_alloca (arg_count * sizeof (NPVariant)));
   for (i = 1; i != invocation->args->len; i++)
   {
-    if (!npfrida_object_gvalue_to_npvariant (self->object->g_object, &g_array_index (invocation->args, GValue, i), &args[i - 1]))
+    if (i == invocation->message_index && invocation->message != NULL)
+      npfrida_json_document_to_npvariant (invocation->message, self->object->g_object->priv->npp, &args[i - 1]);
+    else if (!npfrida_object_gvalue_to_npvariant (self->object->g_object, &g_array_index (invocation->args, GValue, i), &args[i - 1]))
     {
       success = FALSE;
       g_debug ("failed to convert argument %u to a variant", i - 1);
     }
   }
 
-  if (success)
+  for (i = 0; success && i != invocation->listeners->len; i++)
   {
+    NPFridaListener * listener = static_cast<NPFridaListener *> (g_ptr_array_index (invocation->listeners, i));
     NPVariant result;
 
     VOID_TO_NPVARIANT (result);
-    npfrida_nsfuncs->invokeDefault (self->object->g_object->priv->npp, self->callback, args, arg_count, &result);
+    npfrida_nsfuncs->invokeDefault (self->object->g_object->priv->npp, listener->callback, args, arg_count, &result);
     npfrida_nsfuncs->releasevariantvalue (&result);
   }
 
@@ -821,7 +1542,13 @@ npfrida_closure_invoke (void * data)
     npfrida_nsfuncs->releasevariantvalue (&args[i]);
 
   for (i = 0; i != invocation->args->len; i++)
-    g_value_reset (&g_array_index (invocation->args, GValue, i));
+    g_value_unset (&g_array_index (invocation->args, GValue, i));
   g_array_free (invocation->args, TRUE);
+  if (invocation->message != NULL)
+    g_object_unref (invocation->message);
+  g_ptr_array_unref (invocation->listeners);
+  NPFRIDA_TRACE_END ("signal", "deliver", self->signal_name, start);
+
+  g_closure_unref (&self->closure);
   g_slice_free (NPFridaClosureInvocation, invocation);
 }
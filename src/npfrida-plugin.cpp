@@ -1,8 +1,13 @@
 #include "npfrida-plugin.h"
 
 #include "npfrida.h"
+#include "npfrida-browser-queue.h"
+#include "npfrida-log.h"
 #include "npfrida-object.h"
 #include "npfrida-object-priv.h"
+#include "npfrida-record.h"
+#include "npfrida-trace.h"
+#include "npfrida-work-source.h"
 
 #include <frida-core.h>
 #ifdef G_OS_WIN32
@@ -12,9 +17,24 @@
 #endif
 #include "npfunctions.h"
 
-static gchar npfrida_mime_description[] = "application/x-vnd-frida:.frida:ole.andre.ravnas@tillitech.com";
+typedef struct _NPFridaInstance NPFridaInstance;
+typedef struct _NPFridaPrewarm NPFridaPrewarm;
 
-static gint npfrida_get_process_id (void);
+struct _NPFridaInstance
+{
+  NPFridaBrowserQueue * browser_queue;
+  NPFridaWorkQueue * work_queue;
+  gboolean lazy_json;
+  gboolean prewarm;
+};
+
+struct _NPFridaPrewarm
+{
+  NPFridaWorkItem work;
+  NPFridaRoot * root;
+};
+
+static gchar npfrida_mime_description[] = "application/x-vnd-frida:.frida:ole.andre.ravnas@tillitech.com";
 
 NPNetscapeFuncs * npfrida_nsfuncs = NULL;
 GMainContext * npfrida_main_context = NULL;
@@ -22,46 +42,36 @@ GMainContext * npfrida_main_context = NULL;
 G_LOCK_DEFINE_STATIC (npfrida_plugin);
 static GHashTable * npfrida_plugin_roots = NULL;
 static NPP npfrida_logging_instance = NULL;
-
-static void
-npfrida_log (const gchar * log_domain, GLogLevelFlags log_level, const gchar * message, gpointer user_data)
-{
-  NPNetscapeFuncs * browser = npfrida_nsfuncs;
-  NPP instance = static_cast<NPP> (user_data);
-  NPObject * window = NULL, * console = NULL;
-  NPVariant variant, result;
-  NPError error;
-
-  (void) log_domain;
-  (void) log_level;
-
-  error = browser->getvalue (instance, NPNVWindowNPObject, &window);
-  if (error != NPERR_NO_ERROR)
-    goto beach;
-
-  VOID_TO_NPVARIANT (variant);
-  if (!browser->getproperty (instance, window, browser->getstringidentifier ("console"), &variant))
-    goto beach;
-  console = NPVARIANT_TO_OBJECT (variant);
-
-  STRINGZ_TO_NPVARIANT (message, variant);
-  VOID_TO_NPVARIANT (result);
-  if (!browser->invoke (instance, console, browser->getstringidentifier ("log"), &variant, 1, &result))
-    goto beach;
-  browser->releasevariantvalue (&result);
-
-beach:
-  if (console != NULL)
-    browser->releaseobject (console);
-  if (window != NULL)
-    browser->releaseobject (window);
-}
-
+static gboolean npfrida_started = FALSE;
+
+static NPObject * npfrida_plugin_obtain_root (NPP instance);
+static void npfrida_plugin_prewarm (NPP instance);
+static void npfrida_plugin_do_prewarm (NPFridaWorkItem * item);
+
+/*
+ * frida-core and its thread are only brought up once a page asks for the
+ * scriptable object, so merely loading the plugin stays cheap. Everything
+ * that registers types or hooks into GLib follows frida_init, as it did
+ * when this ran at load time. Called with the plugin lock held.
+ */
 static void
 npfrida_startup (void)
 {
+  if (npfrida_started)
+    return;
+
   g_setenv ("G_DEBUG", "fatal-warnings:fatal-criticals", TRUE);
   frida_init ();
+
+  npfrida_object_type_init ();
+  npfrida_trace_init ();
+  npfrida_record_init ();
+  npfrida_log_init ();
+
+  npfrida_main_context = frida_get_main_context ();
+  npfrida_work_source_init (npfrida_main_context);
+
+  npfrida_started = TRUE;
 }
 
 static void
@@ -71,7 +81,7 @@ npfrida_init_logging (NPP instance)
     return;
 
   npfrida_logging_instance = instance;
-  g_log_set_default_handler (npfrida_log, instance);
+  npfrida_log_set_target (instance);
 }
 
 static void
@@ -84,7 +94,7 @@ npfrida_deinit_logging (NPP instance)
 
   if (g_hash_table_size (npfrida_plugin_roots) == 0)
   {
-    g_log_set_default_handler (g_log_default_handler, NULL);
+    npfrida_log_set_target (NULL);
   }
   else
   {
@@ -101,11 +111,11 @@ static NPError
 npfrida_plugin_new (NPMIMEType plugin_type, NPP instance, uint16_t mode, int16_t argc, char * argn[], char * argv[],
     NPSavedData * saved)
 {
+  NPFridaInstance * data;
+  gint i;
+
   (void) plugin_type;
   (void) mode;
-  (void) argc;
-  (void) argn;
-  (void) argv;
   (void) saved;
 
 #ifdef HAVE_MAC
@@ -128,6 +138,21 @@ npfrida_plugin_new (NPMIMEType plugin_type, NPP instance, uint16_t mode, int16_t
 
   npfrida_nsfuncs->setvalue (instance, NPPVpluginWindowBool, NULL);
 
+  data = g_slice_new (NPFridaInstance);
+  data->browser_queue = npfrida_browser_queue_new (instance);
+  data->work_queue = npfrida_work_queue_new ();
+  data->lazy_json = FALSE;
+  data->prewarm = FALSE;
+  instance->pdata = data;
+
+  for (i = 0; i != argc; i++)
+  {
+    if (g_ascii_strcasecmp (argn[i], "materialize") == 0)
+      data->lazy_json = g_ascii_strcasecmp (argv[i], "lazy") == 0;
+    else if (g_ascii_strcasecmp (argn[i], "prewarm") == 0)
+      data->prewarm = g_ascii_strcasecmp (argv[i], "true") == 0;
+  }
+
   G_LOCK (npfrida_plugin);
   g_hash_table_insert (npfrida_plugin_roots, instance, NULL);
   npfrida_init_logging (instance);
@@ -141,6 +166,7 @@ npfrida_plugin_new (NPMIMEType plugin_type, NPP instance, uint16_t mode, int16_t
 static NPError
 npfrida_plugin_destroy (NPP instance, NPSavedData ** saved)
 {
+  NPFridaInstance * data = static_cast<NPFridaInstance *> (instance->pdata);
   NPFridaNPObject * root_object;
 
   (void) saved;
@@ -157,6 +183,11 @@ npfrida_plugin_destroy (NPP instance, NPSavedData ** saved)
   npfrida_deinit_logging (instance);
   G_UNLOCK (npfrida_plugin);
 
+  npfrida_browser_queue_unref (data->browser_queue);
+  npfrida_work_queue_unref (data->work_queue);
+  g_slice_free (NPFridaInstance, data);
+  instance->pdata = NULL;
+
   g_debug ("Frida plugin %p destroyed in pid %d", instance, npfrida_get_process_id ());
 
   return NPERR_NO_ERROR;
@@ -165,9 +196,20 @@ npfrida_plugin_destroy (NPP instance, NPSavedData ** saved)
 static NPError
 npfrida_plugin_set_window (NPP instance, NPWindow * window)
 {
-  (void) instance;
+  NPFridaInstance * data = static_cast<NPFridaInstance *> (instance->pdata);
+
   (void) window;
 
+  /* Not from NPP_New, some browsers have no usable window object that early */
+  if (data->prewarm)
+  {
+    data->prewarm = FALSE;
+
+    G_LOCK (npfrida_plugin);
+    npfrida_plugin_prewarm (instance);
+    G_UNLOCK (npfrida_plugin);
+  }
+
   return NPERR_NO_ERROR;
 }
 
@@ -195,12 +237,7 @@ npfrida_plugin_get_value (NPP instance, NPPVariable variable, void * value)
       NPObject * obj;
 
       G_LOCK (npfrida_plugin);
-      obj = static_cast<NPObject *> (g_hash_table_lookup (npfrida_plugin_roots, instance));
-      if (obj == NULL)
-      {
-        obj = npfrida_nsfuncs->createobject (instance, static_cast<NPClass *> (npfrida_object_type_get_np_class (NPFRIDA_TYPE_ROOT)));
-        g_hash_table_insert (npfrida_plugin_roots, instance, obj);
-      }
+      obj = npfrida_plugin_obtain_root (instance);
       npfrida_nsfuncs->retainobject (obj);
       G_UNLOCK (npfrida_plugin);
 
@@ -214,6 +251,54 @@ npfrida_plugin_get_value (NPP instance, NPPVariable variable, void * value)
   return NPERR_NO_ERROR;
 }
 
+/* Called with the plugin lock held */
+static NPObject *
+npfrida_plugin_obtain_root (NPP instance)
+{
+  NPObject * obj;
+
+  obj = static_cast<NPObject *> (g_hash_table_lookup (npfrida_plugin_roots, instance));
+  if (obj == NULL)
+  {
+    npfrida_startup ();
+    obj = npfrida_nsfuncs->createobject (instance, static_cast<NPClass *> (npfrida_object_type_get_np_class (NPFRIDA_TYPE_ROOT)));
+    g_hash_table_insert (npfrida_plugin_roots, instance, obj);
+  }
+
+  return obj;
+}
+
+/*
+ * Opted into with <embed prewarm="true">: the root is created on the first
+ * NPP_SetWindow and device discovery plus a first process snapshot start in
+ * the background, so the page's first enumerate calls find them ready.
+ * Called with the plugin lock held.
+ */
+static void
+npfrida_plugin_prewarm (NPP instance)
+{
+  NPFridaNPObject * root_object;
+  NPFridaPrewarm * prewarm;
+
+  root_object = reinterpret_cast<NPFridaNPObject *> (npfrida_plugin_obtain_root (instance));
+
+  prewarm = g_slice_new (NPFridaPrewarm);
+  prewarm->root = NPFRIDA_ROOT (g_object_ref (root_object->g_object));
+  npfrida_work_queue_submit (npfrida_plugin_get_work_queue (instance), NPFRIDA_WORK_CALL, &prewarm->work,
+      npfrida_plugin_do_prewarm);
+}
+
+static void
+npfrida_plugin_do_prewarm (NPFridaWorkItem * item)
+{
+  NPFridaPrewarm * prewarm = reinterpret_cast<NPFridaPrewarm *> (item);
+
+  npfrida_root_prewarm (prewarm->root);
+
+  g_object_unref (prewarm->root);
+  g_slice_free (NPFridaPrewarm, prewarm);
+}
+
 static void
 npfrida_root_object_destroy (gpointer data)
 {
@@ -254,8 +339,6 @@ NP_GetValue (void * reserved, NPPVariable variable, void * value)
 NPError OSCALL
 NP_GetEntryPoints (NPPluginFuncs * pf)
 {
-  npfrida_startup ();
-
   pf->version = (NP_VERSION_MAJOR << 8) | NP_VERSION_MINOR;
   pf->newp = npfrida_plugin_new;
   pf->destroy = npfrida_plugin_destroy;
@@ -278,38 +361,62 @@ NP_Initialize (NPNetscapeFuncs * nf)
 
 #ifdef HAVE_LINUX
   NP_GetEntryPoints (pf);
-#else
-  npfrida_startup ();
 #endif
 
-  npfrida_object_type_init ();
-
   npfrida_nsfuncs = nf;
   npfrida_plugin_roots = g_hash_table_new_full (NULL, NULL, NULL, npfrida_root_object_destroy);
 
-  npfrida_main_context = frida_get_main_context ();
-
   return NPERR_NO_ERROR;
 }
 
 NPError OSCALL
 NP_Shutdown (void)
 {
-  frida_shutdown ();
+  if (npfrida_started)
+  {
+    frida_shutdown ();
 
-  npfrida_main_context = NULL;
+    npfrida_work_source_deinit ();
+    npfrida_main_context = NULL;
+  }
 
   g_hash_table_unref (npfrida_plugin_roots);
   npfrida_plugin_roots = NULL;
   npfrida_nsfuncs = NULL;
 
-  npfrida_object_type_deinit ();
+  /* frida-core cannot be initialized again once torn down, so this waits for the library to be unloaded */
+  if (npfrida_started)
+  {
+    npfrida_object_type_deinit ();
+    npfrida_trace_deinit ();
+    npfrida_record_deinit ();
+    npfrida_log_deinit ();
 
-  frida_deinit ();
+    frida_deinit ();
+    npfrida_started = FALSE;
+  }
 
   return NPERR_NO_ERROR;
 }
 
+NPFridaBrowserQueue *
+npfrida_plugin_get_browser_queue (NPP instance)
+{
+  return static_cast<NPFridaInstance *> (instance->pdata)->browser_queue;
+}
+
+NPFridaWorkQueue *
+npfrida_plugin_get_work_queue (NPP instance)
+{
+  return static_cast<NPFridaInstance *> (instance->pdata)->work_queue;
+}
+
+gboolean
+npfrida_plugin_get_lazy_json (NPP instance)
+{
+  return static_cast<NPFridaInstance *> (instance->pdata)->lazy_json;
+}
+
 void
 npfrida_init_npvariant_with_string (NPVariant * var, const gchar * str)
 {
@@ -355,7 +462,7 @@ npfrida_npobject_release (gpointer npobject)
   npfrida_nsfuncs->releaseobject (static_cast<NPObject *> (npobject));
 }
 
-static gint
+gint
 npfrida_get_process_id (void)
 {
 #ifdef G_OS_WIN32
@@ -16,6 +16,9 @@
 
 G_BEGIN_DECLS
 
+typedef struct _NPFridaBrowserQueue NPFridaBrowserQueue;
+typedef struct _NPFridaWorkQueue NPFridaWorkQueue;
+
 char * NP_GetMIMEDescription (void);
 NPError OSCALL NP_GetValue (void * reserved, NPPVariable variable, void * value);
 NPError OSCALL NP_GetEntryPoints (NPPluginFuncs * pf);
@@ -29,6 +32,12 @@ NPError OSCALL NP_Shutdown (void);
 G_GNUC_INTERNAL extern NPNetscapeFuncs * npfrida_nsfuncs;
 G_GNUC_INTERNAL extern GMainContext * npfrida_main_context;
 
+G_GNUC_INTERNAL NPFridaBrowserQueue * npfrida_plugin_get_browser_queue (NPP instance);
+G_GNUC_INTERNAL NPFridaWorkQueue * npfrida_plugin_get_work_queue (NPP instance);
+G_GNUC_INTERNAL gboolean npfrida_plugin_get_lazy_json (NPP instance);
+
+G_GNUC_INTERNAL gint npfrida_get_process_id (void);
+
 G_GNUC_INTERNAL void npfrida_init_npvariant_with_string (NPVariant * var, const gchar * str);
 G_GNUC_INTERNAL gchar * npfrida_npstring_to_cstring (const NPString * s);
 G_GNUC_INTERNAL void npfrida_init_npvariant_with_other (NPVariant * var, const NPVariant * other);
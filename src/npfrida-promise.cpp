@@ -1,6 +1,9 @@
 #include "npfrida-promise.h"
 
+#include "npfrida-browser-queue.h"
 #include "npfrida-plugin.h"
+#include "npfrida-record.h"
+#include "npfrida-trace.h"
 
 #include <string.h>
 
@@ -13,6 +16,7 @@ static void npfrida_promise_deliver (NPFridaPromise * self, NPFridaPromiseResult
 static void npfrida_promise_flush (void * data);
 static void npfrida_promise_flush_unlocked (NPFridaPromise * self);
 static void npfrida_promise_invoke_callback (gpointer data, gpointer user_data);
+static bool npfrida_promise_do_invoke (NPObject * npobj, NPIdentifier name, const NPVariant * args, uint32_t arg_count, NPVariant * result);
 
 static NPObject *
 npfrida_promise_allocate (NPP npp, NPClass * klass)
@@ -23,6 +27,7 @@ npfrida_promise_allocate (NPP npp, NPClass * klass)
 
   promise = g_slice_new0 (NPFridaPromise);
   promise->npp = npp;
+  promise->browser_queue = npfrida_browser_queue_ref (npfrida_plugin_get_browser_queue (npp));
 
   g_mutex_init (&promise->mutex);
 
@@ -42,9 +47,14 @@ npfrida_promise_deallocate (NPObject * npobj)
   NPFridaPromise * promise = reinterpret_cast<NPFridaPromise *> (npobj);
   guint i;
 
+  npfrida_record_forget (npobj);
+
   if (promise->destroy_user_data != NULL)
     promise->destroy_user_data (promise->user_data);
 
+  if (promise->cancellable != NULL)
+    g_object_unref (promise->cancellable);
+
   g_mutex_clear (&promise->mutex);
 
   for (i = 0; i != promise->args->len; i++)
@@ -55,6 +65,8 @@ npfrida_promise_deallocate (NPObject * npobj)
   g_ptr_array_unref (promise->on_failure);
   g_ptr_array_unref (promise->on_complete);
 
+  npfrida_browser_queue_unref (promise->browser_queue);
+
   g_slice_free (NPFridaPromise, promise);
 }
 
@@ -76,6 +88,28 @@ npfrida_promise_reject (NPFridaPromise * self, const NPVariant * args, guint arg
   npfrida_promise_deliver (self, NPFRIDA_PROMISE_FAILURE, args, arg_count);
 }
 
+/*
+ * Settles the promise from the browser thread, taking ownership of args and
+ * running any pending callbacks right away instead of scheduling a flush.
+ */
+void
+npfrida_promise_complete (NPFridaPromise * self, NPFridaPromiseResult result, NPVariant * args, guint arg_count)
+{
+  g_assert (result != NPFRIDA_PROMISE_PENDING);
+
+  NPFRIDA_PROMISE_LOCK ();
+
+  g_assert (self->result == NPFRIDA_PROMISE_PENDING);
+  self->result = result;
+
+  g_array_set_size (self->args, 0);
+  g_array_append_vals (self->args, args, arg_count);
+
+  npfrida_promise_flush_unlocked (self);
+
+  NPFRIDA_PROMISE_UNLOCK ();
+}
+
 static void
 npfrida_promise_deliver (NPFridaPromise * self, NPFridaPromiseResult result, const NPVariant * args, guint arg_count)
 {
@@ -93,7 +127,7 @@ npfrida_promise_deliver (NPFridaPromise * self, NPFridaPromiseResult result, con
   NPFRIDA_PROMISE_UNLOCK ();
 
   npfrida_nsfuncs->retainobject (&self->np_object);
-  npfrida_nsfuncs->pluginthreadasynccall (self->npp, npfrida_promise_flush, self);
+  npfrida_browser_queue_push (self->browser_queue, npfrida_promise_flush, self);
 }
 
 static void
@@ -112,10 +146,13 @@ static void
 npfrida_promise_flush_unlocked (NPFridaPromise * self)
 {
   GPtrArray * on_success, * on_failure, * on_complete;
+  gint64 start;
 
   if (self->result == NPFRIDA_PROMISE_PENDING)
     return;
 
+  start = NPFRIDA_TRACE_BEGIN ();
+
   on_success = self->on_success; self->on_success = g_ptr_array_new_with_free_func (npfrida_npobject_release);
   on_failure = self->on_failure; self->on_failure = g_ptr_array_new_with_free_func (npfrida_npobject_release);
   on_complete = self->on_complete; self->on_complete = g_ptr_array_new_with_free_func (npfrida_npobject_release);
@@ -132,6 +169,8 @@ npfrida_promise_flush_unlocked (NPFridaPromise * self)
   g_ptr_array_unref (on_failure);
   g_ptr_array_unref (on_complete);
 
+  NPFRIDA_TRACE_END ("promise", "flush", NULL, start);
+
   NPFRIDA_PROMISE_LOCK ();
 }
 
@@ -155,6 +194,7 @@ npfrida_promise_has_method (NPObject * npobj, NPIdentifier name)
   (void) npobj;
 
   return (strcmp (function_name, "always") == 0 ||
+      strcmp (function_name, "cancel") == 0 ||
       strcmp (function_name, "done") == 0 ||
       strcmp (function_name, "fail") == 0 ||
       strcmp (function_name, "state") == 0);
@@ -162,6 +202,27 @@ npfrida_promise_has_method (NPObject * npobj, NPIdentifier name)
 
 static bool
 npfrida_promise_invoke (NPObject * npobj, NPIdentifier name, const NPVariant * args, uint32_t arg_count, NPVariant * result)
+{
+  gint64 record_start;
+  bool success;
+
+  record_start = NPFRIDA_RECORD_BEGIN ();
+  if (record_start != 0)
+    VOID_TO_NPVARIANT (*result);
+
+  success = npfrida_promise_do_invoke (npobj, name, args, arg_count, result);
+
+  if (record_start != 0)
+  {
+    npfrida_record_call (NPFRIDA_RECORD_INVOKE, reinterpret_cast<NPFridaPromise *> (npobj)->npp, npobj, name,
+        args, arg_count, result, record_start);
+  }
+
+  return success;
+}
+
+static bool
+npfrida_promise_do_invoke (NPObject * npobj, NPIdentifier name, const NPVariant * args, uint32_t arg_count, NPVariant * result)
 {
   NPFridaPromise * self = reinterpret_cast<NPFridaPromise *> (npobj);
   const gchar * function_name = static_cast<NPString *> (name)->UTF8Characters;
@@ -171,6 +232,7 @@ npfrida_promise_invoke (NPObject * npobj, NPIdentifier name, const NPVariant * a
   if (strcmp (function_name, "state") == 0)
   {
     const gchar * state = NULL;
+    NPFridaPromiseResult current;
 
     if (arg_count != 0)
     {
@@ -178,7 +240,11 @@ npfrida_promise_invoke (NPObject * npobj, NPIdentifier name, const NPVariant * a
       return true;
     }
 
-    switch (self->result)
+    NPFRIDA_PROMISE_LOCK ();
+    current = self->result;
+    NPFRIDA_PROMISE_UNLOCK ();
+
+    switch (current)
     {
       case NPFRIDA_PROMISE_PENDING:
         state = "pending";
@@ -193,6 +259,29 @@ npfrida_promise_invoke (NPObject * npobj, NPIdentifier name, const NPVariant * a
 
     npfrida_init_npvariant_with_string (result, state);
   }
+  else if (strcmp (function_name, "cancel") == 0)
+  {
+    gboolean pending;
+
+    if (arg_count != 0)
+    {
+      npfrida_nsfuncs->setexception (npobj, "invalid argument");
+      return true;
+    }
+
+    NPFRIDA_PROMISE_LOCK ();
+    pending = self->result == NPFRIDA_PROMISE_PENDING;
+    NPFRIDA_PROMISE_UNLOCK ();
+
+    /*
+     * The promise is rejected once the operation notices the cancellation.
+     * Cancelling happens outside the lock as handlers may settle the promise.
+     */
+    if (pending && self->cancellable != NULL)
+      g_cancellable_cancel (self->cancellable);
+
+    VOID_TO_NPVARIANT (*result);
+  }
   else
   {
     if (arg_count != 1 || args[0].type != NPVariantType_Object)
@@ -3,6 +3,8 @@
 
 #include "npfrida-plugin.h"
 
+#include <gio/gio.h>
+
 typedef struct _NPFridaPromise NPFridaPromise;
 typedef gint NPFridaPromiseResult;
 
@@ -19,9 +21,11 @@ struct _NPFridaPromise
 
   gpointer user_data;
   GDestroyNotify destroy_user_data;
+  GCancellable * cancellable;
 
   /*< private */
   NPP npp;
+  NPFridaBrowserQueue * browser_queue;
   GMutex mutex;
   NPFridaPromiseResult result;
   GArray * args;
@@ -34,5 +38,6 @@ NPObject * npfrida_promise_new (NPP npp, gpointer user_data, GDestroyNotify dest
 
 void npfrida_promise_resolve (NPFridaPromise * self, const NPVariant * args, guint arg_count);
 void npfrida_promise_reject (NPFridaPromise * self, const NPVariant * args, guint arg_count);
+void npfrida_promise_complete (NPFridaPromise * self, NPFridaPromiseResult result, NPVariant * args, guint arg_count);
 
 #endif
@@ -0,0 +1,232 @@
+#include "npfrida-record.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+static void npfrida_record_write_value (NPP npp, NPObject * target, const NPVariant * value, gboolean is_result);
+static void npfrida_record_write_varint (guint64 value);
+static void npfrida_record_write_string (const gchar * str, gsize length);
+static guint npfrida_record_lookup_handle (NPObject * obj);
+static guint npfrida_record_assign_handle (NPObject * obj);
+
+volatile gboolean npfrida_record_enabled = FALSE;
+
+/* Only touched from the browser thread, which is the only caller of NPClass entry points */
+static FILE * npfrida_record_file = NULL;
+static GHashTable * npfrida_record_handles = NULL;
+static guint npfrida_record_next_handle = 1;
+static gint64 npfrida_record_last_start = 0;
+
+void
+npfrida_record_init (void)
+{
+  const gchar * path;
+
+  path = g_getenv ("NPFRIDA_RECORD");
+  if (path == NULL || path[0] == '\0')
+    return;
+
+  npfrida_record_file = g_fopen (path, "wb");
+  if (npfrida_record_file == NULL)
+  {
+    g_warning ("Failed to open %s for recording", path);
+    return;
+  }
+  setvbuf (npfrida_record_file, NULL, _IOFBF, 64 * 1024);
+  fwrite (NPFRIDA_RECORD_MAGIC, 1, NPFRIDA_RECORD_MAGIC_SIZE, npfrida_record_file);
+
+  npfrida_record_handles = g_hash_table_new (NULL, NULL);
+  npfrida_record_next_handle = 1;
+  npfrida_record_last_start = 0;
+  npfrida_record_enabled = TRUE;
+}
+
+void
+npfrida_record_deinit (void)
+{
+  if (!npfrida_record_enabled)
+    return;
+
+  npfrida_record_enabled = FALSE;
+
+  fclose (npfrida_record_file);
+  npfrida_record_file = NULL;
+
+  g_hash_table_unref (npfrida_record_handles);
+  npfrida_record_handles = NULL;
+}
+
+void
+npfrida_record_call (NPFridaRecordKind kind, NPP npp, NPObject * target, NPIdentifier name,
+    const NPVariant * args, uint32_t arg_count, const NPVariant * result, gint64 start)
+{
+  const NPString * name_str = static_cast<NPString *> (name);
+  gint64 end;
+  uint32_t i;
+
+  if (!npfrida_record_enabled || start == 0)
+    return;
+
+  end = g_get_monotonic_time ();
+
+  fputc (kind, npfrida_record_file);
+  npfrida_record_write_varint ((npfrida_record_last_start != 0) ? start - npfrida_record_last_start : 0);
+  npfrida_record_write_varint (end - start);
+  npfrida_record_write_varint (npfrida_record_lookup_handle (target));
+  npfrida_record_write_string (name_str->UTF8Characters, strlen (name_str->UTF8Characters));
+  npfrida_record_write_varint (arg_count);
+  for (i = 0; i != arg_count; i++)
+    npfrida_record_write_value (npp, target, &args[i], FALSE);
+  npfrida_record_write_value (npp, target, result, TRUE);
+
+  npfrida_record_last_start = start;
+}
+
+void
+npfrida_record_forget (NPObject * obj)
+{
+  if (npfrida_record_enabled)
+    g_hash_table_remove (npfrida_record_handles, obj);
+}
+
+static void
+npfrida_record_write_value (NPP npp, NPObject * target, const NPVariant * value, gboolean is_result)
+{
+  switch (value->type)
+  {
+    case NPVariantType_Void:
+      fputc (NPFRIDA_RECORD_VOID, npfrida_record_file);
+      break;
+    case NPVariantType_Null:
+      fputc (NPFRIDA_RECORD_NULL, npfrida_record_file);
+      break;
+    case NPVariantType_Bool:
+      fputc (NPVARIANT_TO_BOOLEAN (*value) ? NPFRIDA_RECORD_TRUE : NPFRIDA_RECORD_FALSE, npfrida_record_file);
+      break;
+    case NPVariantType_Int32:
+    {
+      gint32 v = NPVARIANT_TO_INT32 (*value);
+
+      fputc (NPFRIDA_RECORD_INT32, npfrida_record_file);
+      npfrida_record_write_varint ((static_cast<guint32> (v) << 1) ^ static_cast<guint32> (v >> 31));
+      break;
+    }
+    case NPVariantType_Double:
+    {
+      gdouble v = NPVARIANT_TO_DOUBLE (*value);
+      guint64 bits;
+
+      memcpy (&bits, &v, sizeof (bits));
+      bits = GUINT64_TO_LE (bits);
+      fputc (NPFRIDA_RECORD_DOUBLE, npfrida_record_file);
+      fwrite (&bits, sizeof (bits), 1, npfrida_record_file);
+      break;
+    }
+    case NPVariantType_String:
+      fputc (NPFRIDA_RECORD_STRING, npfrida_record_file);
+      npfrida_record_write_string (value->value.stringValue.UTF8Characters, value->value.stringValue.UTF8Length);
+      break;
+    case NPVariantType_Object:
+    {
+      NPObject * obj = NPVARIANT_TO_OBJECT (*value);
+      NPObject * window = NULL;
+      NPVariant json, str;
+      guint handle;
+
+      if (is_result)
+      {
+        if (obj == target)
+        {
+          fputc (NPFRIDA_RECORD_SELF, npfrida_record_file);
+        }
+        else
+        {
+          fputc (NPFRIDA_RECORD_NEW_OBJECT, npfrida_record_file);
+          npfrida_record_write_varint (npfrida_record_assign_handle (obj));
+        }
+        break;
+      }
+
+      handle = GPOINTER_TO_UINT (g_hash_table_lookup (npfrida_record_handles, obj));
+      if (handle != 0)
+      {
+        fputc (NPFRIDA_RECORD_OBJECT, npfrida_record_file);
+        npfrida_record_write_varint (handle);
+        break;
+      }
+
+      VOID_TO_NPVARIANT (str);
+      if (npfrida_nsfuncs->getvalue (npp, NPNVWindowNPObject, &window) == NPERR_NO_ERROR)
+      {
+        if (npfrida_nsfuncs->getproperty (npp, window, npfrida_nsfuncs->getstringidentifier ("JSON"), &json))
+        {
+          if (NPVARIANT_IS_OBJECT (json))
+            npfrida_nsfuncs->invoke (npp, NPVARIANT_TO_OBJECT (json), npfrida_nsfuncs->getstringidentifier ("stringify"), value, 1, &str);
+          npfrida_nsfuncs->releasevariantvalue (&json);
+        }
+        npfrida_nsfuncs->releaseobject (window);
+      }
+
+      /* Functions do not survive JSON.stringify, which is how callbacks are told apart from plain objects */
+      if (NPVARIANT_IS_STRING (str))
+      {
+        fputc (NPFRIDA_RECORD_JSON, npfrida_record_file);
+        npfrida_record_write_string (str.value.stringValue.UTF8Characters, str.value.stringValue.UTF8Length);
+      }
+      else
+      {
+        fputc (NPFRIDA_RECORD_FUNCTION, npfrida_record_file);
+      }
+      npfrida_nsfuncs->releasevariantvalue (&str);
+
+      break;
+    }
+  }
+}
+
+static void
+npfrida_record_write_varint (guint64 value)
+{
+  do
+  {
+    guint8 b = value & 0x7f;
+
+    value >>= 7;
+    if (value != 0)
+      b |= 0x80;
+    fputc (b, npfrida_record_file);
+  }
+  while (value != 0);
+}
+
+static void
+npfrida_record_write_string (const gchar * str, gsize length)
+{
+  npfrida_record_write_varint (length);
+  fwrite (str, 1, length, npfrida_record_file);
+}
+
+/* Objects first seen as a call target, such as the root object, get a handle on the spot */
+static guint
+npfrida_record_lookup_handle (NPObject * obj)
+{
+  guint handle;
+
+  handle = GPOINTER_TO_UINT (g_hash_table_lookup (npfrida_record_handles, obj));
+  if (handle == 0)
+    handle = npfrida_record_assign_handle (obj);
+
+  return handle;
+}
+
+static guint
+npfrida_record_assign_handle (NPObject * obj)
+{
+  guint handle;
+
+  handle = npfrida_record_next_handle++;
+  g_hash_table_insert (npfrida_record_handles, obj, GUINT_TO_POINTER (handle));
+
+  return handle;
+}
@@ -0,0 +1,62 @@
+#ifndef __NPFRIDA_RECORD_H__
+#define __NPFRIDA_RECORD_H__
+
+#include "npfrida-plugin.h"
+
+/*
+ * A recording starts with NPFRIDA_RECORD_MAGIC, followed by one record per
+ * call made by the browser into an NPClass entry point:
+ *
+ *   u8 kind, varint start delta (us), varint duration (us), varint target,
+ *   string name, varint argument count, values..., value result
+ *
+ * Varints are unsigned LEB128, strings are a varint length followed by the
+ * bytes. Each value is a tag byte followed by its payload, see below. A
+ * target handle that no earlier NEW_OBJECT introduced is the scriptable
+ * object of the plugin instance.
+ */
+#define NPFRIDA_RECORD_MAGIC "NPFREC01"
+#define NPFRIDA_RECORD_MAGIC_SIZE 8
+
+G_BEGIN_DECLS
+
+typedef gint NPFridaRecordKind;
+typedef gint NPFridaRecordTag;
+
+enum _NPFridaRecordKind
+{
+  NPFRIDA_RECORD_INVOKE = 1,
+  NPFRIDA_RECORD_GET_PROPERTY
+};
+
+enum _NPFridaRecordTag
+{
+  NPFRIDA_RECORD_VOID,
+  NPFRIDA_RECORD_NULL,
+  NPFRIDA_RECORD_FALSE,
+  NPFRIDA_RECORD_TRUE,
+  NPFRIDA_RECORD_INT32,        /* zigzag varint */
+  NPFRIDA_RECORD_DOUBLE,       /* 8 bytes, little endian */
+  NPFRIDA_RECORD_STRING,       /* string */
+  NPFRIDA_RECORD_JSON,         /* string, a browser object passed through JSON.stringify */
+  NPFRIDA_RECORD_FUNCTION,     /* a browser object that does not stringify, i.e. a callback */
+  NPFRIDA_RECORD_OBJECT,       /* varint handle of a plugin object seen before */
+  NPFRIDA_RECORD_NEW_OBJECT,   /* varint handle assigned to a plugin object returned here */
+  NPFRIDA_RECORD_SELF          /* the target itself, e.g. chained promise methods */
+};
+
+G_GNUC_INTERNAL extern volatile gboolean npfrida_record_enabled;
+
+#define NPFRIDA_RECORD_BEGIN() \
+    (npfrida_record_enabled ? g_get_monotonic_time () : 0)
+
+G_GNUC_INTERNAL void npfrida_record_init (void);
+G_GNUC_INTERNAL void npfrida_record_deinit (void);
+
+G_GNUC_INTERNAL void npfrida_record_call (NPFridaRecordKind kind, NPP npp, NPObject * target, NPIdentifier name,
+    const NPVariant * args, uint32_t arg_count, const NPVariant * result, gint64 start);
+G_GNUC_INTERNAL void npfrida_record_forget (NPObject * obj);
+
+G_END_DECLS
+
+#endif
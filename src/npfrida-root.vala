@@ -1,56 +1,80 @@
+#if !NPFRIDA_MOCK
 namespace NPFrida {
 	public class Root : Object, RootApi {
-		private Frida.DeviceManager manager = new Frida.DeviceManager ();
+		private DeviceHub hub;
+		private ulong changed_handler;
+		private bool destroyed = false;
 		private Gee.ArrayList<Entry> entries = new Gee.ArrayList<Entry> ();
 
-		construct {
-			manager.changed.connect (on_changed);
+		protected override async void destroy () {
+			destroyed = true;
+
+			foreach (var entry in entries.to_array ()) {
+				yield entry.close ();
+				try {
+					yield hub.release_session (entry.device, entry.session);
+				} catch (Error e) {
+				}
+			}
+			entries.clear ();
+
+			if (hub != null) {
+				hub.disconnect (changed_handler);
+				yield hub.release ();
+				hub = null;
+			}
 		}
 
-		protected override async void destroy () {
-			yield manager.close ();
-			manager = null;
+		/* Roots are created on the browser thread, so the hub is picked up on first use */
+		private DeviceHub get_hub () {
+			if (hub == null) {
+				hub = DeviceHub.obtain ();
+				changed_handler = hub.changed.connect (on_changed);
+			}
+			return hub;
 		}
 
-		public async string enumerate_devices () throws Error {
-			var builder = new Json.Builder ();
-			builder.begin_array ();
-			var devices = yield manager.enumerate_devices ();
+		public async Variant enumerate_devices (Cancellable? cancellable = null) throws Error {
+			var devices = yield get_hub ().enumerate_devices ();
+			check_cancelled (cancellable);
+			var builder = new VariantBuilder (new VariantType ("aa{sv}"));
 			var count = devices.size ();
 			for (var i = 0; i != count; i++) {
 				var device = devices.get (i);
-				builder.begin_object ();
-				builder.set_member_name ("id").add_int_value (device.id);
-				builder.set_member_name ("name").add_string_value (device.name);
-				append_icon ("icon", device.icon, builder);
-				builder.set_member_name ("type").add_string_value (device_type_to_string (device.dtype));
-				builder.end_object ();
+				builder.open (VariantType.VARDICT);
+				builder.add ("{sv}", "id", new Variant.uint32 (device.id));
+				builder.add ("{sv}", "name", new Variant.string (device.name));
+				add_icon (builder, "icon", device.icon);
+				builder.add ("{sv}", "type", new Variant.string (device_type_to_string (device.dtype)));
+				builder.close ();
 			}
-			builder.end_array ();
-			var generator = new Json.Generator ();
-			generator.set_root (builder.get_root ());
-			return generator.to_data (null);
+			return builder.end ();
 		}
 
-		public async string enumerate_processes (uint device_id) throws Error {
+		public async Variant enumerate_processes (uint device_id, Cancellable? cancellable = null) throws Error {
 			var device = yield get_device_by_id (device_id);
-			var builder = new Json.Builder ();
-			builder.begin_array ();
-			var processes = yield device.enumerate_processes ();
+			check_cancelled (cancellable);
+			var processes = yield get_hub ().enumerate_processes (device);
+			check_cancelled (cancellable);
+			var builder = new VariantBuilder (new VariantType ("aa{sv}"));
 			var count = processes.size ();
 			for (var i = 0; i != count; i++) {
 				var process = processes.get (i);
-				builder.begin_object ();
-				builder.set_member_name ("pid").add_int_value (process.pid);
-				builder.set_member_name ("name").add_string_value (process.name);
-				append_icon ("small_icon", process.small_icon, builder);
-				append_icon ("large_icon", process.large_icon, builder);
-				builder.end_object ();
+				builder.open (VariantType.VARDICT);
+				builder.add ("{sv}", "pid", new Variant.uint32 (process.pid));
+				builder.add ("{sv}", "name", new Variant.string (process.name));
+				add_icon (builder, "small_icon", process.small_icon);
+				add_icon (builder, "large_icon", process.large_icon);
+				builder.close ();
 			}
-			builder.end_array ();
-			var generator = new Json.Generator ();
-			generator.set_root (builder.get_root ());
-			return generator.to_data (null);
+			return builder.end ();
+		}
+
+		/* Warms up the device index and a snapshot of local processes while the page is still loading */
+		public void prewarm () {
+			if (destroyed)
+				return;
+			get_hub ().prewarm.begin ();
 		}
 
 		private static string device_type_to_string (Frida.DeviceType type) {
@@ -66,32 +90,41 @@ namespace NPFrida {
 			}
 		}
 
-		private static void append_icon (string member_name, Frida.Icon? icon, Json.Builder builder) {
+		private static void add_icon (VariantBuilder builder, string member_name, Frida.Icon? icon) {
 			if (icon == null)
 				return;
-			var image = builder.set_member_name (member_name);
-			image.begin_object ();
-			image.set_member_name ("width").add_int_value (icon.width);
-			image.set_member_name ("height").add_int_value (icon.height);
-			image.set_member_name ("rowstride").add_int_value (icon.rowstride);
-			image.set_member_name ("pixels").add_string_value (Base64.encode (icon.pixels));
-			image.end_object ();
+			var image = new VariantBuilder (VariantType.VARDICT);
+			image.add ("{sv}", "width", new Variant.int32 (icon.width));
+			image.add ("{sv}", "height", new Variant.int32 (icon.height));
+			image.add ("{sv}", "rowstride", new Variant.int32 (icon.rowstride));
+			image.add ("{sv}", "pixels", new Variant.from_bytes (VariantType.BYTESTRING, new Bytes (icon.pixels), true));
+			builder.add ("{sv}", member_name, image.end ());
 		}
 
-		public async void attach_to (uint device_id, uint pid, string source) throws Error {
+		public async void attach_to (uint device_id, uint pid, string source, Cancellable? cancellable = null) throws Error {
 			var entry = yield get_entry (device_id, pid, false);
-			yield entry.load_script (source);
+			check_cancelled (cancellable);
+			yield entry.load_script (source, cancellable);
 		}
 
-		public async void post_message (uint device_id, uint pid, string message) throws Error {
+		public async void post_message (uint device_id, uint pid, string message, Cancellable? cancellable = null) throws Error {
 			var entry = yield get_entry (device_id, pid, true);
+			check_cancelled (cancellable);
 			yield entry.post_message (message);
 		}
 
-		public async void detach_from (uint device_id, uint pid) throws Error {
+		public async void detach_from (uint device_id, uint pid, Cancellable? cancellable = null) throws Error {
 			var entry = yield get_entry (device_id, pid, true);
-			yield entry.unload_script ();
-			yield entry.session.detach ();
+			check_cancelled (cancellable);
+			entries.remove (entry);
+			yield entry.close ();
+			yield get_hub ().release_session (entry.device, entry.session);
+			detach (device_id, pid);
+		}
+
+		private static void check_cancelled (Cancellable? cancellable) throws IOError {
+			if (cancellable != null)
+				cancellable.set_error_if_cancelled ();
 		}
 
 		private void on_changed () {
@@ -99,17 +132,33 @@ namespace NPFrida {
 		}
 
 		private async Entry get_entry (uint device_id, uint pid, bool must_exist) throws Error {
+			var entry = find_entry (device_id, pid);
+			if (entry != null)
+				return entry;
+			if (must_exist)
+				throw new IOError.FAILED ("not attached");
+
 			var device = yield get_device_by_id (device_id);
-			var session = yield device.attach (pid);
+			var session = yield get_hub ().acquire_session (device, pid);
+
+			/* A concurrent call on this root may have won the race */
+			entry = find_entry (device_id, pid);
+			if (entry != null) {
+				yield hub.release_session (device, session);
+				return entry;
+			}
+
+			entry = new Entry (this, device, session);
+			entries.add (entry);
+			return entry;
+		}
+
+		private Entry? find_entry (uint device_id, uint pid) {
 			foreach (var entry in entries) {
-				if (entry.session == session)
+				if (entry.device.id == device_id && entry.session.pid == pid)
 					return entry;
 			}
-			if (must_exist)
-				throw new IOError.FAILED ("not attached");
-			var e = new Entry (this, device, session);
-			entries.add (e);
-			return e;
+			return null;
 		}
 
 		private void _release_entry (Entry entry) {
@@ -118,7 +167,7 @@ namespace NPFrida {
 		}
 
 		private async Frida.Device get_device_by_id (uint device_id) throws Error {
-			var devices = yield manager.enumerate_devices ();
+			var devices = yield get_hub ().enumerate_devices ();
 			var count = devices.size ();
 			for (var i = 0; i < count; i++) {
 				var device = devices.get (i);
@@ -141,17 +190,32 @@ namespace NPFrida {
 
 			private weak Root parent;
 			private Frida.Script script;
+			private ulong detached_handler;
 
 			public Entry (Root parent, Frida.Device device, Frida.Session session) {
 				this.parent = parent;
 				this.device = device;
 				this.session = session;
-				session.detached.connect (on_session_detached);
+				detached_handler = session.detached.connect (on_session_detached);
 			}
 
-			public async void load_script (string source) throws Error {
+			public async void close () {
+				session.disconnect (detached_handler);
+				try {
+					yield unload_script ();
+				} catch (Error e) {
+				}
+			}
+
+			public async void load_script (string source, Cancellable? cancellable) throws Error {
+				if (cancellable != null)
+					cancellable.set_error_if_cancelled ();
 				yield unload_script ();
 				var s = yield session.create_script (source);
+				if (cancellable != null && cancellable.is_cancelled ()) {
+					yield s.unload ();
+					throw new IOError.CANCELLED ("Operation was cancelled");
+				}
 				s.message.connect (on_script_message);
 				yield s.load ();
 				script = s;
@@ -186,4 +250,194 @@ namespace NPFrida {
 			}
 		}
 	}
+
+	/*
+	 * One device monitor, device index and session table per process, shared
+	 * by the roots of all plugin instances. Only touched from the frida thread.
+	 */
+	internal class DeviceHub : GLib.Object {
+		public signal void changed ();
+
+		private static DeviceHub shared;
+
+		private const int64 SNAPSHOT_MAX_AGE = 10 * 1000000;
+
+		private Frida.DeviceManager manager = new Frida.DeviceManager ();
+		private Frida.DeviceList devices;
+		private Gee.HashMap<string, SessionShare> sessions = new Gee.HashMap<string, SessionShare> ();
+		private Gee.HashMap<uint, ProcessSnapshot> snapshots = new Gee.HashMap<uint, ProcessSnapshot> ();
+		private uint users = 0;
+
+		construct {
+			manager.changed.connect (on_changed);
+		}
+
+		public static DeviceHub obtain () {
+			if (shared == null)
+				shared = new DeviceHub ();
+			shared.users++;
+			return shared;
+		}
+
+		public async void release () {
+			if (--users != 0)
+				return;
+			if (shared == this)
+				shared = null;
+			devices = null;
+			snapshots.clear ();
+			foreach (var share in sessions.values) {
+				if (share.session != null)
+					share.session.disconnect (share.detached_handler);
+			}
+			sessions.clear ();
+			yield manager.close ();
+		}
+
+		public async Frida.DeviceList enumerate_devices () throws Error {
+			if (devices == null)
+				devices = yield manager.enumerate_devices ();
+			return devices;
+		}
+
+		public async void prewarm () {
+			try {
+				var list = yield enumerate_devices ();
+				var count = list.size ();
+				for (var i = 0; i != count; i++) {
+					var device = list.get (i);
+					if (device.dtype == Frida.DeviceType.LOCAL && !snapshots.has_key (device.id)) {
+						yield take_snapshot (device);
+						break;
+					}
+				}
+			} catch (Error e) {
+			}
+		}
+
+		/* A snapshot left by prewarm () serves the first enumeration of that device, if recent enough */
+		public async Frida.ProcessList enumerate_processes (Frida.Device device) throws Error {
+			var snapshot = snapshots[device.id];
+			if (snapshot == null)
+				return yield device.enumerate_processes ();
+			if (snapshot.processes == null)
+				yield snapshot.wait ();
+			if (snapshots[device.id] == snapshot)
+				snapshots.unset (device.id);
+			if (get_monotonic_time () - snapshot.taken > SNAPSHOT_MAX_AGE)
+				return yield device.enumerate_processes ();
+			return snapshot.processes;
+		}
+
+		private async void take_snapshot (Frida.Device device) {
+			var snapshot = new ProcessSnapshot ();
+			snapshots[device.id] = snapshot;
+			try {
+				snapshot.processes = yield device.enumerate_processes ();
+				snapshot.taken = get_monotonic_time ();
+				snapshot.complete ();
+			} catch (Error e) {
+				if (snapshots[device.id] == snapshot)
+					snapshots.unset (device.id);
+				snapshot.fail (e);
+			}
+		}
+
+		/* Sessions are reference counted, a root only attaches if no other root has */
+		public async Frida.Session acquire_session (Frida.Device device, uint pid) throws Error {
+			var key = make_session_key (device.id, pid);
+			var share = sessions[key];
+			if (share == null) {
+				share = new SessionShare ();
+				sessions[key] = share;
+				var start = Trace.begin ();
+				try {
+					share.session = yield device.attach (pid);
+					Trace.end ("frida", "attach", null, start);
+				} catch (Error e) {
+					Trace.end ("frida", "attach", null, start);
+					sessions.unset (key);
+					share.fail (e);
+					throw e;
+				}
+				share.detached_handler = share.session.detached.connect (() => {
+					share.session.disconnect (share.detached_handler);
+					if (sessions[key] == share)
+						sessions.unset (key);
+				});
+				share.complete ();
+			} else if (share.session == null) {
+				yield share.wait ();
+			}
+			share.users++;
+			return share.session;
+		}
+
+		public async void release_session (Frida.Device device, Frida.Session session) throws Error {
+			var key = make_session_key (device.id, session.pid);
+			var share = sessions[key];
+			if (share == null || share.session != session)
+				return;
+			if (--share.users != 0)
+				return;
+			sessions.unset (key);
+			session.disconnect (share.detached_handler);
+			var start = Trace.begin ();
+			yield session.detach ();
+			Trace.end ("frida", "detach", null, start);
+		}
+
+		private static string make_session_key (uint device_id, uint pid) {
+			return "%u:%u".printf (device_id, pid);
+		}
+
+		private void on_changed () {
+			devices = null;
+			changed ();
+		}
+
+		private class SessionShare : Completion {
+			public Frida.Session session;
+			public ulong detached_handler;
+			public uint users = 0;
+		}
+
+		private class ProcessSnapshot : Completion {
+			public Frida.ProcessList processes;
+			public int64 taken;
+		}
+
+		/* Lets callers wait for an operation that another caller already started */
+		private class Completion : GLib.Object {
+			private string error_message;
+			private Gee.ArrayList<Waiter> waiters = new Gee.ArrayList<Waiter> ();
+
+			public async void wait () throws Error {
+				waiters.add (new Waiter (wait.callback));
+				yield;
+				if (error_message != null)
+					throw new IOError.FAILED ("%s", error_message);
+			}
+
+			public void complete () {
+				foreach (var waiter in waiters)
+					waiter.callback ();
+				waiters.clear ();
+			}
+
+			public void fail (Error e) {
+				error_message = e.message;
+				complete ();
+			}
+		}
+
+		private class Waiter {
+			public SourceFunc callback;
+
+			public Waiter (owned SourceFunc callback) {
+				this.callback = (owned) callback;
+			}
+		}
+	}
 }
+#endif
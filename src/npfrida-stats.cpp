@@ -0,0 +1,184 @@
+#include "npfrida-stats.h"
+
+/*
+ * Log-linear buckets: values below 8us get a bucket each, above that every
+ * power of two is split into 8 sub-buckets, which bounds the error to 12.5%.
+ */
+#define NPFRIDA_HISTOGRAM_SUB_BUCKET_BITS 3
+#define NPFRIDA_HISTOGRAM_SUB_BUCKETS (1 << NPFRIDA_HISTOGRAM_SUB_BUCKET_BITS)
+#define NPFRIDA_HISTOGRAM_N_BUCKETS ((64 - NPFRIDA_HISTOGRAM_SUB_BUCKET_BITS + 1) * NPFRIDA_HISTOGRAM_SUB_BUCKETS)
+
+typedef struct _NPFridaHistogram NPFridaHistogram;
+
+struct _NPFridaHistogram
+{
+  volatile gint count;
+  volatile gint max;
+  volatile gint buckets[NPFRIDA_HISTOGRAM_N_BUCKETS];
+};
+
+struct _NPFridaMethodStats
+{
+  volatile gint calls;
+  volatile gint failures;
+  NPFridaHistogram phases[NPFRIDA_STATS_N_PHASES];
+};
+
+static const gchar * npfrida_stats_phase_names[NPFRIDA_STATS_N_PHASES] =
+{
+  "marshal",
+  "queueWait",
+  "execute",
+  "browserWait",
+  "convert",
+  "total"
+};
+
+static guint npfrida_histogram_bucket_index (guint64 value);
+static guint64 npfrida_histogram_bucket_value (guint index);
+static void npfrida_histogram_record (NPFridaHistogram * self, guint64 value);
+static void npfrida_histogram_serialize (NPFridaHistogram * self, JsonBuilder * builder);
+
+NPFridaMethodStats *
+npfrida_method_stats_new (void)
+{
+  return g_slice_new0 (NPFridaMethodStats);
+}
+
+void
+npfrida_method_stats_free (gpointer data)
+{
+  g_slice_free (NPFridaMethodStats, static_cast<NPFridaMethodStats *> (data));
+}
+
+void
+npfrida_method_stats_record (NPFridaMethodStats * self, NPFridaStatsPhase phase, gint64 duration)
+{
+  npfrida_histogram_record (&self->phases[phase], (duration > 0) ? duration : 0);
+}
+
+void
+npfrida_method_stats_count_call (NPFridaMethodStats * self, gboolean success)
+{
+  g_atomic_int_inc (&self->calls);
+  if (!success)
+    g_atomic_int_inc (&self->failures);
+}
+
+void
+npfrida_method_stats_serialize (NPFridaMethodStats * self, JsonBuilder * builder)
+{
+  guint i;
+
+  json_builder_begin_object (builder);
+
+  json_builder_set_member_name (builder, "calls");
+  json_builder_add_int_value (builder, g_atomic_int_get (&self->calls));
+  json_builder_set_member_name (builder, "failures");
+  json_builder_add_int_value (builder, g_atomic_int_get (&self->failures));
+
+  for (i = 0; i != NPFRIDA_STATS_N_PHASES; i++)
+  {
+    json_builder_set_member_name (builder, npfrida_stats_phase_names[i]);
+    npfrida_histogram_serialize (&self->phases[i], builder);
+  }
+
+  json_builder_end_object (builder);
+}
+
+static guint
+npfrida_histogram_bucket_index (guint64 value)
+{
+  gint msb;
+
+  if (value < NPFRIDA_HISTOGRAM_SUB_BUCKETS)
+    return value;
+
+  msb = g_bit_nth_msf (value >> 32, -1);
+  msb = (msb != -1) ? msb + 32 : g_bit_nth_msf (static_cast<gulong> (value & G_MAXUINT32), -1);
+
+  return (msb - NPFRIDA_HISTOGRAM_SUB_BUCKET_BITS + 1) * NPFRIDA_HISTOGRAM_SUB_BUCKETS +
+      ((value >> (msb - NPFRIDA_HISTOGRAM_SUB_BUCKET_BITS)) & (NPFRIDA_HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+static guint64
+npfrida_histogram_bucket_value (guint index)
+{
+  guint shift, sub;
+  guint64 lower;
+
+  if (index < NPFRIDA_HISTOGRAM_SUB_BUCKETS)
+    return index;
+
+  shift = index / NPFRIDA_HISTOGRAM_SUB_BUCKETS - 1;
+  sub = index % NPFRIDA_HISTOGRAM_SUB_BUCKETS;
+  lower = static_cast<guint64> (NPFRIDA_HISTOGRAM_SUB_BUCKETS + sub) << shift;
+
+  /* Midpoint of the bucket */
+  return lower + ((G_GUINT64_CONSTANT (1) << shift) >> 1);
+}
+
+static void
+npfrida_histogram_record (NPFridaHistogram * self, guint64 value)
+{
+  gint clamped, max;
+
+  g_atomic_int_inc (&self->buckets[npfrida_histogram_bucket_index (value)]);
+  g_atomic_int_inc (&self->count);
+
+  clamped = static_cast<gint> (MIN (value, static_cast<guint64> (G_MAXINT)));
+  do
+  {
+    max = g_atomic_int_get (&self->max);
+    if (clamped <= max)
+      break;
+  }
+  while (!g_atomic_int_compare_and_exchange (&self->max, max, clamped));
+}
+
+static void
+npfrida_histogram_serialize (NPFridaHistogram * self, JsonBuilder * builder)
+{
+  static const gdouble quantiles[] = { 0.5, 0.9, 0.99 };
+  static const gchar * quantile_names[] = { "p50", "p90", "p99" };
+  guint64 counts[NPFRIDA_HISTOGRAM_N_BUCKETS];
+  guint64 total = 0, seen = 0;
+  gdouble sum = 0;
+  guint i, q = 0;
+
+  /* A snapshot; buckets recorded concurrently may or may not be included */
+  for (i = 0; i != NPFRIDA_HISTOGRAM_N_BUCKETS; i++)
+  {
+    counts[i] = g_atomic_int_get (&self->buckets[i]);
+    total += counts[i];
+    sum += static_cast<gdouble> (counts[i]) * npfrida_histogram_bucket_value (i);
+  }
+
+  json_builder_begin_object (builder);
+
+  json_builder_set_member_name (builder, "count");
+  json_builder_add_int_value (builder, total);
+  json_builder_set_member_name (builder, "mean");
+  json_builder_add_double_value (builder, (total != 0) ? sum / total : 0.0);
+
+  for (i = 0; i != NPFRIDA_HISTOGRAM_N_BUCKETS && q != G_N_ELEMENTS (quantiles); i++)
+  {
+    seen += counts[i];
+    while (q != G_N_ELEMENTS (quantiles) && seen != 0 && seen >= quantiles[q] * total)
+    {
+      json_builder_set_member_name (builder, quantile_names[q]);
+      json_builder_add_int_value (builder, npfrida_histogram_bucket_value (i));
+      q++;
+    }
+  }
+  for (; q != G_N_ELEMENTS (quantiles); q++)
+  {
+    json_builder_set_member_name (builder, quantile_names[q]);
+    json_builder_add_int_value (builder, 0);
+  }
+
+  json_builder_set_member_name (builder, "max");
+  json_builder_add_int_value (builder, g_atomic_int_get (&self->max));
+
+  json_builder_end_object (builder);
+}
@@ -0,0 +1,35 @@
+#ifndef __NPFRIDA_STATS_H__
+#define __NPFRIDA_STATS_H__
+
+#include "npfrida-plugin.h"
+
+#include <json-glib/json-glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _NPFridaMethodStats NPFridaMethodStats;
+typedef gint NPFridaStatsPhase;
+
+enum _NPFridaStatsPhase
+{
+  NPFRIDA_STATS_MARSHAL,
+  NPFRIDA_STATS_QUEUE_WAIT,
+  NPFRIDA_STATS_EXECUTE,
+  NPFRIDA_STATS_BROWSER_WAIT,
+  NPFRIDA_STATS_CONVERT,
+  NPFRIDA_STATS_TOTAL,
+
+  NPFRIDA_STATS_N_PHASES
+};
+
+G_GNUC_INTERNAL NPFridaMethodStats * npfrida_method_stats_new (void);
+G_GNUC_INTERNAL void npfrida_method_stats_free (gpointer data);
+
+G_GNUC_INTERNAL void npfrida_method_stats_record (NPFridaMethodStats * self, NPFridaStatsPhase phase, gint64 duration);
+G_GNUC_INTERNAL void npfrida_method_stats_count_call (NPFridaMethodStats * self, gboolean success);
+
+G_GNUC_INTERNAL void npfrida_method_stats_serialize (NPFridaMethodStats * self, JsonBuilder * builder);
+
+G_END_DECLS
+
+#endif
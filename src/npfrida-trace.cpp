@@ -0,0 +1,250 @@
+#include "npfrida-trace.h"
+
+#include <gio/gio.h>
+#include <json-glib/json-glib.h>
+#include <string.h>
+
+#define NPFRIDA_TRACE_BUFFER_SIZE 16384
+
+typedef struct _NPFridaTraceEvent NPFridaTraceEvent;
+typedef struct _NPFridaTraceBuffer NPFridaTraceBuffer;
+
+/*
+ * Strings are never copied: category and name are literals, detail must be
+ * interned, so recording a span is a handful of stores into the ring.
+ *
+ * Each ring has a single writer, its own thread, which publishes an event
+ * by bumping written. A dump copies the ring without stopping the writer
+ * and then drops whatever the writer may have overwritten meanwhile.
+ */
+struct _NPFridaTraceEvent
+{
+  const gchar * category;
+  const gchar * name;
+  const gchar * detail;
+  gint64 start;
+  gint64 end;
+};
+
+struct _NPFridaTraceBuffer
+{
+  guint thread_id;
+  gboolean is_frida_thread;
+  volatile guint written;
+  NPFridaTraceEvent events[NPFRIDA_TRACE_BUFFER_SIZE];
+};
+
+static NPFridaTraceBuffer * npfrida_trace_get_buffer (void);
+static guint npfrida_trace_buffer_snapshot (NPFridaTraceBuffer * buffer, NPFridaTraceEvent * events);
+
+volatile gboolean npfrida_trace_enabled = FALSE;
+
+G_LOCK_DEFINE_STATIC (npfrida_trace);
+static GPtrArray * npfrida_trace_buffers = NULL;
+static gchar * npfrida_trace_path = NULL;
+static GPrivate npfrida_trace_current = G_PRIVATE_INIT (NULL);
+
+void
+npfrida_trace_init (void)
+{
+  const gchar * path;
+
+  path = g_getenv ("NPFRIDA_TRACE");
+  if (path == NULL || path[0] == '\0')
+    return;
+
+  npfrida_trace_path = g_strdup (path);
+  /* Buffers are kept for the lifetime of the process as threads hold on to them */
+  if (npfrida_trace_buffers == NULL)
+    npfrida_trace_buffers = g_ptr_array_new ();
+  npfrida_trace_enabled = TRUE;
+}
+
+void
+npfrida_trace_deinit (void)
+{
+  GError * error = NULL;
+
+  if (!npfrida_trace_enabled)
+    return;
+
+  if (!npfrida_trace_dump (&error))
+  {
+    g_warning ("Failed to write trace to %s: %s", npfrida_trace_path, error->message);
+    g_clear_error (&error);
+  }
+
+  npfrida_trace_enabled = FALSE;
+
+  g_free (npfrida_trace_path);
+  npfrida_trace_path = NULL;
+}
+
+void
+npfrida_trace_record (const gchar * category, const gchar * name, const gchar * detail, gint64 start, gint64 end)
+{
+  NPFridaTraceBuffer * buffer;
+  NPFridaTraceEvent * event;
+  guint written;
+
+  buffer = npfrida_trace_get_buffer ();
+
+  /* Nobody else writes this ring, so the index can be read without a barrier */
+  written = buffer->written;
+  event = &buffer->events[written % NPFRIDA_TRACE_BUFFER_SIZE];
+  event->category = category;
+  event->name = name;
+  event->detail = detail;
+  event->start = start;
+  event->end = end;
+  g_atomic_int_set (&buffer->written, written + 1);
+}
+
+gboolean
+npfrida_trace_dump (GError ** error)
+{
+  JsonBuilder * builder;
+  JsonGenerator * generator;
+  JsonNode * root;
+  NPFridaTraceEvent * events;
+  gint pid;
+  guint i;
+  gboolean success;
+
+  if (!npfrida_trace_enabled)
+  {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "tracing is not enabled, set NPFRIDA_TRACE");
+    return FALSE;
+  }
+
+  pid = npfrida_get_process_id ();
+
+  builder = json_builder_new ();
+  json_builder_begin_object (builder);
+  json_builder_set_member_name (builder, "traceEvents");
+  json_builder_begin_array (builder);
+
+  events = g_new (NPFridaTraceEvent, NPFRIDA_TRACE_BUFFER_SIZE);
+
+  G_LOCK (npfrida_trace);
+  for (i = 0; i != npfrida_trace_buffers->len; i++)
+  {
+    NPFridaTraceBuffer * buffer = static_cast<NPFridaTraceBuffer *> (g_ptr_array_index (npfrida_trace_buffers, i));
+    guint count, j;
+
+    json_builder_begin_object (builder);
+    json_builder_set_member_name (builder, "ph");
+    json_builder_add_string_value (builder, "M");
+    json_builder_set_member_name (builder, "name");
+    json_builder_add_string_value (builder, "thread_name");
+    json_builder_set_member_name (builder, "pid");
+    json_builder_add_int_value (builder, pid);
+    json_builder_set_member_name (builder, "tid");
+    json_builder_add_int_value (builder, buffer->thread_id);
+    json_builder_set_member_name (builder, "args");
+    json_builder_begin_object (builder);
+    json_builder_set_member_name (builder, "name");
+    json_builder_add_string_value (builder, buffer->is_frida_thread ? "frida" : "browser");
+    json_builder_end_object (builder);
+    json_builder_end_object (builder);
+
+    count = npfrida_trace_buffer_snapshot (buffer, events);
+    for (j = 0; j != count; j++)
+    {
+      NPFridaTraceEvent * event = &events[j];
+
+      json_builder_begin_object (builder);
+      json_builder_set_member_name (builder, "ph");
+      json_builder_add_string_value (builder, "X");
+      json_builder_set_member_name (builder, "cat");
+      json_builder_add_string_value (builder, event->category);
+      json_builder_set_member_name (builder, "name");
+      json_builder_add_string_value (builder, event->name);
+      json_builder_set_member_name (builder, "pid");
+      json_builder_add_int_value (builder, pid);
+      json_builder_set_member_name (builder, "tid");
+      json_builder_add_int_value (builder, buffer->thread_id);
+      json_builder_set_member_name (builder, "ts");
+      json_builder_add_int_value (builder, event->start);
+      json_builder_set_member_name (builder, "dur");
+      json_builder_add_int_value (builder, event->end - event->start);
+      if (event->detail != NULL)
+      {
+        json_builder_set_member_name (builder, "args");
+        json_builder_begin_object (builder);
+        json_builder_set_member_name (builder, "detail");
+        json_builder_add_string_value (builder, event->detail);
+        json_builder_end_object (builder);
+      }
+      json_builder_end_object (builder);
+    }
+  }
+  G_UNLOCK (npfrida_trace);
+
+  g_free (events);
+
+  json_builder_end_array (builder);
+  json_builder_set_member_name (builder, "displayTimeUnit");
+  json_builder_add_string_value (builder, "ms");
+  json_builder_end_object (builder);
+
+  root = json_builder_get_root (builder);
+  generator = json_generator_new ();
+  json_generator_set_root (generator, root);
+  success = json_generator_to_file (generator, npfrida_trace_path, error);
+
+  g_object_unref (generator);
+  json_node_free (root);
+  g_object_unref (builder);
+
+  return success;
+}
+
+static NPFridaTraceBuffer *
+npfrida_trace_get_buffer (void)
+{
+  NPFridaTraceBuffer * buffer;
+
+  buffer = static_cast<NPFridaTraceBuffer *> (g_private_get (&npfrida_trace_current));
+  if (buffer != NULL)
+    return buffer;
+
+  buffer = g_new0 (NPFridaTraceBuffer, 1);
+  buffer->is_frida_thread = npfrida_main_context != NULL && g_main_context_is_owner (npfrida_main_context);
+
+  G_LOCK (npfrida_trace);
+  buffer->thread_id = npfrida_trace_buffers->len + 1;
+  g_ptr_array_add (npfrida_trace_buffers, buffer);
+  G_UNLOCK (npfrida_trace);
+
+  g_private_set (&npfrida_trace_current, buffer);
+
+  return buffer;
+}
+
+/* Copies the published events oldest first, returns how many are intact */
+static guint
+npfrida_trace_buffer_snapshot (NPFridaTraceBuffer * buffer, NPFridaTraceEvent * events)
+{
+  guint before, after, first, count, skip, j;
+  gint64 reused;
+
+  before = g_atomic_int_get (&buffer->written);
+  count = MIN (before, NPFRIDA_TRACE_BUFFER_SIZE);
+  first = before - count;
+  for (j = 0; j != count; j++)
+    events[j] = buffer->events[(first + j) % NPFRIDA_TRACE_BUFFER_SIZE];
+
+  /*
+   * The slot of event n is reused by event n + size. The writer may have
+   * published up to after and be halfway through event after, so every
+   * event below after + 1 - size may have been overwritten while copying.
+   */
+  after = g_atomic_int_get (&buffer->written);
+  reused = static_cast<gint64> (after) + 1 - NPFRIDA_TRACE_BUFFER_SIZE;
+  skip = (reused > first) ? static_cast<guint> (MIN (reused - first, static_cast<gint64> (count))) : 0;
+
+  memmove (events, events + skip, (count - skip) * sizeof (NPFridaTraceEvent));
+
+  return count - skip;
+}
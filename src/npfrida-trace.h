@@ -0,0 +1,28 @@
+#ifndef __NPFRIDA_TRACE_H__
+#define __NPFRIDA_TRACE_H__
+
+#include "npfrida-plugin.h"
+
+G_BEGIN_DECLS
+
+G_GNUC_INTERNAL extern volatile gboolean npfrida_trace_enabled;
+
+#define NPFRIDA_TRACE_BEGIN() \
+    (npfrida_trace_enabled ? g_get_monotonic_time () : 0)
+#define NPFRIDA_TRACE_END(category, name, detail, start) \
+    G_STMT_START \
+    { \
+      if (npfrida_trace_enabled && (start) != 0) \
+        npfrida_trace_record (category, name, detail, start, g_get_monotonic_time ()); \
+    } \
+    G_STMT_END
+
+G_GNUC_INTERNAL void npfrida_trace_init (void);
+G_GNUC_INTERNAL void npfrida_trace_deinit (void);
+
+G_GNUC_INTERNAL void npfrida_trace_record (const gchar * category, const gchar * name, const gchar * detail, gint64 start, gint64 end);
+G_GNUC_INTERNAL gboolean npfrida_trace_dump (GError ** error);
+
+G_END_DECLS
+
+#endif
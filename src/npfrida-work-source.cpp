@@ -0,0 +1,266 @@
+#include "npfrida-work-source.h"
+
+typedef struct _NPFridaWorkSource NPFridaWorkSource;
+typedef struct _NPFridaWorkLane NPFridaWorkLane;
+
+struct _NPFridaWorkSource
+{
+  GSource source;
+
+  NPFridaMpscQueue ready;
+
+  /*< owned by the frida thread */
+  GQueue active;
+};
+
+struct _NPFridaWorkLane
+{
+  NPFridaMpscQueue incoming;
+
+  /*< owned by the frida thread */
+  NPFridaMpscNode * head;
+  NPFridaMpscNode * tail;
+};
+
+struct _NPFridaWorkQueue
+{
+  NPFridaMpscNode node;
+  volatile gint ref_count;
+  volatile gint scheduled;
+  NPFridaWorkLane lanes[NPFRIDA_WORK_N_CLASSES];
+};
+
+static gboolean npfrida_work_source_prepare (GSource * source, gint * timeout);
+static gboolean npfrida_work_source_check (GSource * source);
+static gboolean npfrida_work_source_dispatch (GSource * source, GSourceFunc callback, gpointer user_data);
+static void npfrida_work_source_finalize (GSource * source);
+
+static void npfrida_work_queue_schedule (NPFridaWorkQueue * self);
+static void npfrida_work_queue_serve (NPFridaWorkQueue * self);
+static gboolean npfrida_work_queue_has_work (NPFridaWorkQueue * self);
+
+static GSourceFuncs npfrida_work_source_funcs =
+{
+  npfrida_work_source_prepare,
+  npfrida_work_source_check,
+  npfrida_work_source_dispatch,
+  npfrida_work_source_finalize,
+  NULL,
+  NULL
+};
+
+/* Items of each class that an instance may run per scheduling round */
+static const guint npfrida_work_class_quantum[NPFRIDA_WORK_N_CLASSES] =
+{
+  8, /* NPFRIDA_WORK_INTERACTIVE: the browser thread is blocked waiting */
+  4, /* NPFRIDA_WORK_CALL */
+  1  /* NPFRIDA_WORK_TEARDOWN */
+};
+
+static NPFridaWorkSource * npfrida_work_source = NULL;
+
+void
+npfrida_work_source_init (GMainContext * context)
+{
+  GSource * source;
+
+  g_assert (npfrida_work_source == NULL);
+
+  source = g_source_new (&npfrida_work_source_funcs, sizeof (NPFridaWorkSource));
+  g_source_set_priority (source, G_PRIORITY_HIGH);
+  npfrida_work_source = reinterpret_cast<NPFridaWorkSource *> (source);
+  npfrida_work_source->ready.head = NULL;
+  g_queue_init (&npfrida_work_source->active);
+
+  g_source_attach (source, context);
+}
+
+void
+npfrida_work_source_deinit (void)
+{
+  GSource * source = &npfrida_work_source->source;
+
+  npfrida_work_source = NULL;
+
+  g_source_destroy (source);
+  g_source_unref (source);
+}
+
+static gboolean
+npfrida_work_source_prepare (GSource * source, gint * timeout)
+{
+  *timeout = -1;
+
+  return npfrida_work_source_check (source);
+}
+
+static gboolean
+npfrida_work_source_check (GSource * source)
+{
+  NPFridaWorkSource * self = reinterpret_cast<NPFridaWorkSource *> (source);
+
+  return !g_queue_is_empty (&self->active) || !npfrida_mpsc_queue_is_empty (&self->ready);
+}
+
+/*
+ * Gives every instance with pending work one round, in round-robin order, and
+ * leaves whatever exceeds its quantum for the next iteration of the loop.
+ */
+static gboolean
+npfrida_work_source_dispatch (GSource * source, GSourceFunc callback, gpointer user_data)
+{
+  NPFridaWorkSource * self = reinterpret_cast<NPFridaWorkSource *> (source);
+  NPFridaMpscNode * node;
+  guint remaining;
+
+  (void) callback;
+  (void) user_data;
+
+  for (node = npfrida_mpsc_queue_pop_all (&self->ready); node != NULL;)
+  {
+    NPFridaMpscNode * next = node->next;
+    g_queue_push_tail (&self->active, node);
+    node = next;
+  }
+
+  for (remaining = g_queue_get_length (&self->active); remaining != 0; remaining--)
+  {
+    NPFridaWorkQueue * queue = static_cast<NPFridaWorkQueue *> (g_queue_pop_head (&self->active));
+
+    npfrida_work_queue_serve (queue);
+
+    if (npfrida_work_queue_has_work (queue))
+    {
+      g_queue_push_tail (&self->active, queue);
+      continue;
+    }
+
+    /* Producers that observed the queue as scheduled rely on this re-check */
+    g_atomic_int_set (&queue->scheduled, FALSE);
+    if (npfrida_work_queue_has_work (queue) && g_atomic_int_compare_and_exchange (&queue->scheduled, FALSE, TRUE))
+      g_queue_push_tail (&self->active, queue);
+    else
+      npfrida_work_queue_unref (queue);
+  }
+
+  return TRUE;
+}
+
+static void
+npfrida_work_source_finalize (GSource * source)
+{
+  NPFridaWorkSource * self = reinterpret_cast<NPFridaWorkSource *> (source);
+  NPFridaMpscNode * node;
+
+  for (node = npfrida_mpsc_queue_pop_all (&self->ready); node != NULL;)
+  {
+    NPFridaMpscNode * next = node->next;
+    g_queue_push_tail (&self->active, node);
+    node = next;
+  }
+
+  g_queue_foreach (&self->active, reinterpret_cast<GFunc> (npfrida_work_queue_unref), NULL);
+  g_queue_clear (&self->active);
+}
+
+NPFridaWorkQueue *
+npfrida_work_queue_new (void)
+{
+  NPFridaWorkQueue * queue;
+
+  queue = g_slice_new0 (NPFridaWorkQueue);
+  queue->ref_count = 1;
+
+  return queue;
+}
+
+NPFridaWorkQueue *
+npfrida_work_queue_ref (NPFridaWorkQueue * self)
+{
+  g_atomic_int_inc (&self->ref_count);
+  return self;
+}
+
+void
+npfrida_work_queue_unref (NPFridaWorkQueue * self)
+{
+  if (g_atomic_int_dec_and_test (&self->ref_count))
+  {
+    g_assert (!npfrida_work_queue_has_work (self));
+    g_slice_free (NPFridaWorkQueue, self);
+  }
+}
+
+void
+npfrida_work_queue_submit (NPFridaWorkQueue * self, NPFridaWorkClass klass, NPFridaWorkItem * item, NPFridaWorkFunc func)
+{
+  item->func = func;
+
+  npfrida_mpsc_queue_push (&self->lanes[klass].incoming, &item->node);
+
+  if (!g_atomic_int_get (&self->scheduled) && g_atomic_int_compare_and_exchange (&self->scheduled, FALSE, TRUE))
+    npfrida_work_queue_schedule (self);
+}
+
+static void
+npfrida_work_queue_schedule (NPFridaWorkQueue * self)
+{
+  NPFridaWorkSource * source = npfrida_work_source;
+
+  npfrida_work_queue_ref (self);
+
+  /* A burst of submissions only costs the frida thread a single wakeup */
+  if (npfrida_mpsc_queue_push (&source->ready, &self->node))
+    g_main_context_wakeup (g_source_get_context (&source->source));
+}
+
+static void
+npfrida_work_queue_serve (NPFridaWorkQueue * self)
+{
+  NPFridaWorkClass klass;
+
+  for (klass = 0; klass != NPFRIDA_WORK_N_CLASSES; klass++)
+  {
+    NPFridaWorkLane * lane = &self->lanes[klass];
+    NPFridaMpscNode * incoming;
+    guint quantum;
+
+    incoming = npfrida_mpsc_queue_pop_all (&lane->incoming);
+    if (incoming != NULL)
+    {
+      if (lane->tail != NULL)
+        lane->tail->next = incoming;
+      else
+        lane->head = incoming;
+      for (lane->tail = incoming; lane->tail->next != NULL; lane->tail = lane->tail->next)
+        ;
+    }
+
+    for (quantum = npfrida_work_class_quantum[klass]; quantum != 0 && lane->head != NULL; quantum--)
+    {
+      NPFridaWorkItem * item = reinterpret_cast<NPFridaWorkItem *> (lane->head);
+
+      lane->head = lane->head->next;
+      if (lane->head == NULL)
+        lane->tail = NULL;
+
+      item->func (item);
+    }
+  }
+}
+
+static gboolean
+npfrida_work_queue_has_work (NPFridaWorkQueue * self)
+{
+  NPFridaWorkClass klass;
+
+  for (klass = 0; klass != NPFRIDA_WORK_N_CLASSES; klass++)
+  {
+    NPFridaWorkLane * lane = &self->lanes[klass];
+
+    if (lane->head != NULL || !npfrida_mpsc_queue_is_empty (&lane->incoming))
+      return TRUE;
+  }
+
+  return FALSE;
+}
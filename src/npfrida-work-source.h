@@ -0,0 +1,39 @@
+#ifndef __NPFRIDA_WORK_SOURCE_H__
+#define __NPFRIDA_WORK_SOURCE_H__
+
+#include "npfrida-mpsc-queue.h"
+#include "npfrida-plugin.h"
+
+G_BEGIN_DECLS
+
+typedef struct _NPFridaWorkItem NPFridaWorkItem;
+typedef void (* NPFridaWorkFunc) (NPFridaWorkItem * item);
+typedef gint NPFridaWorkClass;
+
+enum _NPFridaWorkClass
+{
+  NPFRIDA_WORK_INTERACTIVE,
+  NPFRIDA_WORK_CALL,
+  NPFRIDA_WORK_TEARDOWN,
+
+  NPFRIDA_WORK_N_CLASSES
+};
+
+struct _NPFridaWorkItem
+{
+  NPFridaMpscNode node;
+  NPFridaWorkFunc func;
+};
+
+G_GNUC_INTERNAL void npfrida_work_source_init (GMainContext * context);
+G_GNUC_INTERNAL void npfrida_work_source_deinit (void);
+
+G_GNUC_INTERNAL NPFridaWorkQueue * npfrida_work_queue_new (void);
+G_GNUC_INTERNAL NPFridaWorkQueue * npfrida_work_queue_ref (NPFridaWorkQueue * self);
+G_GNUC_INTERNAL void npfrida_work_queue_unref (NPFridaWorkQueue * self);
+
+G_GNUC_INTERNAL void npfrida_work_queue_submit (NPFridaWorkQueue * self, NPFridaWorkClass klass, NPFridaWorkItem * item, NPFridaWorkFunc func);
+
+G_END_DECLS
+
+#endif